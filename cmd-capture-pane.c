@@ -202,6 +202,7 @@ cmd_capture_pane_exec(struct cmd *self, struct cmdq_item *item)
 	if (cmd_get_entry(self) == &cmd_clear_history_entry) {
 		window_pane_reset_mode_all(wp);
 		grid_clear_history(wp->base.grid);
+		format_free_memos(&wp->memos);
 		return (CMD_RETURN_NORMAL);
 	}
 
@@ -159,7 +159,7 @@ draw_text:
 	else
 		gc.fg = colour;
 	tty_attributes(tty, &gc, &grid_default_cell, NULL);
-	tty_puts(tty, buf);
+	tty_putn(tty, buf, len, len);
 
 	tty_cursor(tty, 0, 0);
 }
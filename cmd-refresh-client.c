@@ -42,15 +42,18 @@ const struct cmd_entry cmd_refresh_client_entry = {
 	.exec = cmd_refresh_client_exec
 };
 
-static void
-cmd_refresh_client_update_offset(struct client *tc, const char *value)
+static enum cmd_retval
+cmd_refresh_client_update_offset(struct cmdq_item *item, struct client *tc,
+    const char *value)
 {
 	struct window_pane	*wp;
 	char			*copy, *colon;
-	u_int			 pane;
+	const char		*errstr;
+	u_int			 pane, rate;
+	enum cmd_retval		 retval = CMD_RETURN_NORMAL;
 
 	if (*value != '%')
-		return;
+		return (CMD_RETURN_NORMAL);
 	copy = xstrdup(value);
 	if ((colon = strchr(copy, ':')) == NULL)
 		goto out;
@@ -70,9 +73,20 @@ cmd_refresh_client_update_offset(struct client *tc, const char *value)
 		control_continue_pane(tc, wp);
 	else if (strcmp(colon, "pause") == 0)
 		control_pause_pane(tc, wp);
+	else if (strcmp(colon, "screen") == 0)
+		control_set_pane_screen(tc, wp);
+	else if (strncmp(colon, "rate=", 5) == 0) {
+		rate = strtonum(colon + 5, 0, INT_MAX, &errstr);
+		if (errstr != NULL) {
+			cmdq_error(item, "rate %s", errstr);
+			retval = CMD_RETURN_ERROR;
+		} else
+			control_set_pane_rate(tc, wp, rate);
+	}
 
 out:
 	free(copy);
+	return (retval);
 }
 
 static enum cmd_retval
@@ -151,7 +165,9 @@ cmd_refresh_client_exec(struct cmd *self, struct cmdq_item *item)
 			goto not_control_client;
 		value = args_first_value(args, 'A', &av);
 		while (value != NULL) {
-			cmd_refresh_client_update_offset(tc, value);
+			if (cmd_refresh_client_update_offset(item, tc,
+			    value) == CMD_RETURN_ERROR)
+				return (CMD_RETURN_ERROR);
 			value = args_next_value(&av);
 		}
 		return (CMD_RETURN_NORMAL);
@@ -181,6 +197,7 @@ cmd_refresh_client_exec(struct cmd *self, struct cmdq_item *item)
 		server_status_client(tc);
 	} else {
 		tc->flags |= CLIENT_STATUSFORCE;
+		tty_shadow_invalidate_all(&tc->tty);
 		server_redraw_client(tc);
 	}
 	return (CMD_RETURN_NORMAL);
@@ -27,10 +27,6 @@
 #include <termios.h>
 #include <wchar.h>
 
-#ifdef HAVE_UTF8PROC
-#include <utf8proc.h>
-#endif
-
 #ifndef __GNUC__
 #define __attribute__(a)
 #endif
@@ -376,13 +372,6 @@ void		*reallocarray(void *, size_t, size_t);
 void		*recallocarray(void *, size_t, size_t, size_t);
 #endif
 
-#ifdef HAVE_UTF8PROC
-/* utf8proc.c */
-int		 utf8proc_wcwidth(wchar_t);
-int		 utf8proc_mbtowc(wchar_t *, const char *, size_t);
-int		 utf8proc_wctomb(char *, wchar_t);
-#endif
-
 /* getopt.c */
 extern int	BSDopterr;
 extern int	BSDoptind;
@@ -19,7 +19,10 @@
 
 #include <sys/types.h>
 
+#include <netinet/in.h>
+
 #include <event.h>
+#include <resolv.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -46,6 +49,7 @@ struct control_block {
 	size_t				 size;
 	char				*line;
 	uint64_t			 t;
+	struct window_pane_chunk	*chunk;
 
 	TAILQ_ENTRY(control_block)	 entry;
 	TAILQ_ENTRY(control_block)	 all_entry;
@@ -66,6 +70,26 @@ struct control_pane {
 	int				 flags;
 #define CONTROL_PANE_OFF 0x1
 #define CONTROL_PANE_PAUSED 0x2
+#define CONTROL_PANE_SCREEN 0x4
+#define CONTROL_PANE_CHANGED 0x8
+
+	/*
+	 * Screen mode state: the lines and cursor position last sent. Lines
+	 * are sent again only if they have changed.
+	 */
+	char				**lines;
+	u_int				  nlines;
+	u_int				  sx;
+	u_int				  cx;
+	u_int				  cy;
+
+	/*
+	 * Rate limit in bytes per second (0 if none). Output over the limit is
+	 * held back and sent together once there are enough tokens.
+	 */
+	size_t				 rate;
+	size_t				 tokens;
+	uint64_t			 tokens_time;
 
 	int				 pending_flag;
 	TAILQ_ENTRY(control_pane)	 pending_entry;
@@ -85,17 +109,41 @@ struct control_state {
 
 	TAILQ_HEAD(, control_block)	 all_blocks;
 
+	struct evbuffer			*base64;	/* output to encode */
+
+	/*
+	 * The high watermark is sized from how fast the client has been taking
+	 * output: fill_size is the buffer size when it was last filled to the
+	 * watermark and fill_time when.
+	 */
+	size_t				 high;
+	size_t				 rate;
+	size_t				 fill_size;
+	uint64_t			 fill_time;
+	u_int				 limited;
+	struct event			 rate_timer;
+
+	uint64_t			 screen_time;
+	struct event			 screen_timer;
+
 	struct bufferevent		*read_event;
 	struct bufferevent		*write_event;
 };
 
-/* Low and high watermarks. */
+/* Low watermark and smallest and largest high watermarks. */
 #define CONTROL_BUFFER_LOW 512
 #define CONTROL_BUFFER_HIGH 8192
+#define CONTROL_BUFFER_MAXIMUM 262144
+
+/* Time in milliseconds the client should take to write the buffer. */
+#define CONTROL_BUFFER_TIME 100
 
 /* Minimum to write to each client. */
 #define CONTROL_WRITE_MINIMUM 32
 
+/* Minimum time in milliseconds between screen updates. */
+#define CONTROL_SCREEN_INTERVAL 100
+
 /* Maximum age for clients that are not using pause mode. */
 #define CONTROL_MAXIMUM_AGE 300000
 
@@ -104,6 +152,8 @@ struct control_state {
 	(CLIENT_CONTROL_NOOUTPUT| \
 	 CLIENT_UNATTACHEDFLAGS)
 
+static void	control_schedule_screen(struct client *);
+
 /* Compare client panes. */
 static int
 control_pane_cmp(struct control_pane *cp1, struct control_pane *cp2)
@@ -120,6 +170,8 @@ RB_GENERATE_STATIC(control_panes, control_pane, entry, control_pane_cmp);
 static void
 control_free_block(struct control_state *cs, struct control_block *cb)
 {
+	if (cb->chunk != NULL)
+		window_pane_release_chunk(cb->chunk);
 	free(cb->line);
 	TAILQ_REMOVE(&cs->all_blocks, cb, all_entry);
 	free(cb);
@@ -170,6 +222,19 @@ control_discard_pane(struct client *c, struct control_pane *cp)
 	}
 }
 
+/* Free the lines last sent for a pane in screen mode. */
+static void
+control_free_lines(struct control_pane *cp)
+{
+	u_int	i;
+
+	for (i = 0; i < cp->nlines; i++)
+		free(cp->lines[i]);
+	free(cp->lines);
+	cp->lines = NULL;
+	cp->nlines = 0;
+}
+
 /* Get actual pane for this client. */
 static struct window_pane *
 control_window_pane(struct client *c, u_int pane)
@@ -193,6 +258,8 @@ control_reset_offsets(struct client *c)
 	struct control_pane	*cp, *cp1;
 
 	RB_FOREACH_SAFE(cp, control_panes, &cs->panes, cp1) {
+		control_discard_pane(c, cp);
+		control_free_lines(cp);
 		RB_REMOVE(control_panes, &cs->panes, cp);
 		free(cp);
 	}
@@ -214,7 +281,8 @@ control_pane_offset(struct client *c, struct window_pane *wp, int *off)
 	}
 
 	cp = control_get_pane(c, wp);
-	if (cp == NULL || (cp->flags & CONTROL_PANE_PAUSED)) {
+	if (cp == NULL ||
+	    (cp->flags & (CONTROL_PANE_PAUSED|CONTROL_PANE_SCREEN))) {
 		*off = 0;
 		return (NULL);
 	}
@@ -223,6 +291,10 @@ control_pane_offset(struct client *c, struct window_pane *wp, int *off)
 		return (NULL);
 	}
 	*off = (EVBUFFER_LENGTH(cs->write_event->output) >= CONTROL_BUFFER_LOW);
+
+	/* Stop reading if a second of output is waiting for a rate limit. */
+	if (cp->rate != 0 && cp->queued.used - cp->offset.used >= cp->rate)
+		*off = 1;
 	return (&cp->offset);
 }
 
@@ -233,8 +305,9 @@ control_set_pane_on(struct client *c, struct window_pane *wp)
 	struct control_pane	*cp;
 
 	cp = control_get_pane(c, wp);
-	if (cp != NULL && (cp->flags & CONTROL_PANE_OFF)) {
-		cp->flags &= ~CONTROL_PANE_OFF;
+	if (cp != NULL && (cp->flags & (CONTROL_PANE_OFF|CONTROL_PANE_SCREEN))) {
+		cp->flags &= ~(CONTROL_PANE_OFF|CONTROL_PANE_SCREEN);
+		control_free_lines(cp);
 		memcpy(&cp->offset, &wp->offset, sizeof cp->offset);
 		memcpy(&cp->queued, &wp->offset, sizeof cp->queued);
 	}
@@ -279,6 +352,73 @@ control_pause_pane(struct client *c, struct window_pane *wp)
 	}
 }
 
+/* Set pane to send screen updates rather than output. */
+void
+control_set_pane_screen(struct client *c, struct window_pane *wp)
+{
+	struct control_pane	*cp;
+
+	cp = control_add_pane(c, wp);
+	if (~cp->flags & CONTROL_PANE_SCREEN) {
+		cp->flags |= (CONTROL_PANE_SCREEN|CONTROL_PANE_CHANGED);
+		control_discard_pane(c, cp);
+		control_schedule_screen(c);
+	}
+}
+
+/* Set the rate limit for a pane, 0 for none. */
+void
+control_set_pane_rate(struct client *c, struct window_pane *wp, size_t rate)
+{
+	struct control_pane	*cp;
+
+	cp = control_add_pane(c, wp);
+	if (rate != 0 && rate < CONTROL_WRITE_MINIMUM)
+		rate = CONTROL_WRITE_MINIMUM;
+	cp->rate = rate;
+	cp->tokens = rate;
+	cp->tokens_time = get_timer();
+}
+
+/*
+ * Add tokens for the time since a rate limited pane last had them, up to one
+ * second's worth. Returns how much can be written.
+ */
+static size_t
+control_pane_tokens(struct control_pane *cp, uint64_t t)
+{
+	size_t	add;
+
+	if (cp->rate == 0)
+		return (SIZE_MAX);
+	if (t > cp->tokens_time) {
+		add = cp->rate * (t - cp->tokens_time) / 1000;
+		if (add != 0) {
+			if (add > cp->rate - cp->tokens)
+				add = cp->rate - cp->tokens;
+			cp->tokens += add;
+			cp->tokens_time = t;
+		}
+	}
+	return (cp->tokens);
+}
+
+/* Get flow control counters for formats. */
+void
+control_get_flow(struct client *c, size_t *rate, size_t *high, u_int *limited)
+{
+	struct control_state	*cs = c->control_state;
+
+	if (cs == NULL) {
+		*rate = *high = 0;
+		*limited = 0;
+		return;
+	}
+	*rate = cs->rate;
+	*high = cs->high;
+	*limited = cs->limited;
+}
+
 /* Write a line. */
 static void
 control_vwrite(struct client *c, const char *fmt, va_list ap)
@@ -342,7 +482,11 @@ control_check_age(struct client *c, struct window_pane *wp,
 	log_debug("%s: %s: %%%u is %llu behind", __func__, c->name, wp->id,
 	    (unsigned long long)age);
 
-	if (c->flags & CLIENT_CONTROL_PAUSEAFTER) {
+	/*
+	 * Output held back by a rate limit is expected to get old, so only
+	 * give up on the client if it is very far behind.
+	 */
+	if ((c->flags & CLIENT_CONTROL_PAUSEAFTER) && cp->rate == 0) {
 		if (age < c->pause_age)
 			return (0);
 		cp->flags |= CONTROL_PANE_PAUSED;
@@ -358,6 +502,103 @@ control_check_age(struct client *c, struct window_pane *wp,
 	return (1);
 }
 
+/*
+ * Start the timer for screen updates if it is not running. Updates are sent
+ * at most every CONTROL_SCREEN_INTERVAL, so a pane changing many times in that
+ * time only sends one update.
+ */
+static void
+control_schedule_screen(struct client *c)
+{
+	struct control_state	*cs = c->control_state;
+	struct timeval		 tv = { 0 };
+	uint64_t		 t, next;
+
+	if (evtimer_pending(&cs->screen_timer, NULL))
+		return;
+	t = get_timer();
+	next = cs->screen_time + CONTROL_SCREEN_INTERVAL;
+	if (next > t) {
+		tv.tv_sec = (next - t) / 1000;
+		tv.tv_usec = ((next - t) % 1000) * 1000;
+	}
+	evtimer_add(&cs->screen_timer, &tv);
+}
+
+/*
+ * Write the lines of a pane which have changed since the last update, then
+ * the size and cursor position.
+ */
+static void
+control_write_screen(struct client *c, struct window_pane *wp,
+    struct control_pane *cp)
+{
+	struct screen		*s = &wp->base;
+	struct grid		*gd = s->grid;
+	struct grid_cell	*gc;
+	u_int			 sx = screen_size_x(s), sy = screen_size_y(s);
+	u_int			 i, n = 0;
+	char			*line;
+
+	if (sy != cp->nlines || sx != cp->sx) {
+		control_free_lines(cp);
+		cp->lines = xcalloc(sy, sizeof *cp->lines);
+		cp->nlines = sy;
+		cp->sx = sx;
+	}
+
+	for (i = 0; i < sy; i++) {
+		gc = NULL;
+		line = grid_string_cells(gd, 0, gd->hsize + i, sx, &gc, 1, 1,
+		    1);
+		if (cp->lines[i] != NULL && strcmp(line, cp->lines[i]) == 0) {
+			free(line);
+			continue;
+		}
+		control_write(c, "%%screen-line %%%u %u %s", wp->id, i, line);
+		free(cp->lines[i]);
+		cp->lines[i] = line;
+		n++;
+	}
+	if (n == 0 && s->cx == cp->cx && s->cy == cp->cy)
+		return;
+	cp->cx = s->cx;
+	cp->cy = s->cy;
+	control_write(c, "%%screen %%%u %u %u %u %u", wp->id, sx, sy, s->cx,
+	    s->cy);
+}
+
+/* Screen timer. Write updates for any panes in screen mode that changed. */
+static void
+control_screen_timer(__unused int fd, __unused short events, void *data)
+{
+	struct client		*c = data;
+	struct control_state	*cs = c->control_state;
+	struct control_pane	*cp;
+	struct window_pane	*wp;
+
+	cs->screen_time = get_timer();
+	if (c->flags & CONTROL_IGNORE_FLAGS)
+		return;
+
+	RB_FOREACH(cp, control_panes, &cs->panes) {
+		if (~cp->flags & CONTROL_PANE_SCREEN)
+			continue;
+		if (~cp->flags & CONTROL_PANE_CHANGED)
+			continue;
+
+		/* If the client is behind, try again later. */
+		if (EVBUFFER_LENGTH(cs->write_event->output) >= cs->high) {
+			control_schedule_screen(c);
+			return;
+		}
+
+		cp->flags &= ~CONTROL_PANE_CHANGED;
+		if ((wp = control_window_pane(c, cp->pane)) != NULL)
+			control_write_screen(c, wp, cp);
+	}
+}
+
 /* Write output from a pane. */
 void
 control_write_output(struct client *c, struct window_pane *wp)
@@ -365,7 +606,7 @@ control_write_output(struct client *c, struct window_pane *wp)
 	struct control_state	*cs = c->control_state;
 	struct control_pane	*cp;
 	struct control_block	*cb;
-	size_t			 new_size;
+	size_t			 start, new_size;
 
 	if (winlink_find_by_window(&c->session->windows, wp->window) == NULL)
 		return;
@@ -379,9 +620,24 @@ control_write_output(struct client *c, struct window_pane *wp)
 	cp = control_add_pane(c, wp);
 	if (cp->flags & (CONTROL_PANE_OFF|CONTROL_PANE_PAUSED))
 		goto ignore;
+	if (cp->flags & CONTROL_PANE_SCREEN) {
+		cp->flags |= CONTROL_PANE_CHANGED;
+		control_schedule_screen(c);
+		goto ignore;
+	}
 	if (control_check_age(c, wp, cp))
 		return;
 
+	/*
+	 * Output is only kept for clients with data queued, so if this pane
+	 * was not in the client's session for a while, some may have gone.
+	 */
+	if (cp->queued.used < wp->base_offset) {
+		cp->offset.used = wp->base_offset;
+		cp->queued.used = wp->base_offset;
+	}
+
+	start = cp->queued.used;
 	window_pane_get_new_data(wp, &cp->queued, &new_size);
 	if (new_size == 0)
 		return;
@@ -389,6 +645,7 @@ control_write_output(struct client *c, struct window_pane *wp)
 
 	cb = xcalloc(1, sizeof *cb);
 	cb->size = new_size;
+	cb->chunk = window_pane_add_chunk(wp, start, start + new_size);
 	TAILQ_INSERT_TAIL(&cs->all_blocks, cb, all_entry);
 	cb->t = get_timer();
 
@@ -499,6 +756,77 @@ control_flush_all_blocks(struct client *c)
 	}
 }
 
+/*
+ * Return the length of the run of bytes at the start of a buffer which do not
+ * need to be escaped, that is anything except C0 controls and backslash. This
+ * is checked a word at a time: after masking off the top bit (bytes with it
+ * set are never escaped), adding 0x60 leaves the top bit clear for a byte
+ * below 0x20, and after XOR with backslash adding 0x7f leaves it clear for a
+ * backslash. Neither can carry into the next byte.
+ */
+static size_t
+control_safe_data(const u_char *data, size_t size)
+{
+	const uint64_t	 ones = 0x0101010101010101ULL;
+	const uint64_t	 high = 0x8080808080808080ULL;
+	uint64_t	 w, x, y;
+	size_t		 off = 0;
+
+	while (size - off >= sizeof w) {
+		memcpy(&w, data + off, sizeof w);
+		x = w & ~high;
+		y = x ^ (ones * '\\');
+		if ((~(x + (ones * 0x60)) | ~(y + (ones * 0x7f))) & ~w & high)
+			break;
+		off += sizeof w;
+	}
+	while (off < size && data[off] >= ' ' && data[off] != '\\')
+		off++;
+	return (off);
+}
+
+/*
+ * Escape data into a message. Runs of bytes which do not need escaping are
+ * gathered with the escaped bytes in a local buffer, so the message is only
+ * added to once for each buffer full rather than for every byte.
+ */
+static void
+control_escape_data(struct evbuffer *message, const u_char *data, size_t size)
+{
+	u_char	buf[4096];
+	size_t	used = 0, off = 0, n;
+
+	while (off < size) {
+		n = control_safe_data(data + off, size - off);
+		if (n > sizeof buf - used) {
+			evbuffer_add(message, buf, used);
+			used = 0;
+			if (n >= sizeof buf) {
+				evbuffer_add(message, data + off, n);
+				off += n;
+				n = 0;
+			}
+		}
+		memcpy(buf + used, data + off, n);
+		used += n;
+		off += n;
+		if (off == size)
+			break;
+
+		if (used + 4 > sizeof buf) {
+			evbuffer_add(message, buf, used);
+			used = 0;
+		}
+		buf[used++] = '\\';
+		buf[used++] = '0' + ((data[off] >> 6) & 7);
+		buf[used++] = '0' + ((data[off] >> 3) & 7);
+		buf[used++] = '0' + (data[off] & 7);
+		off++;
+	}
+	if (used != 0)
+		evbuffer_add(message, buf, used);
+}
+
 /* Append data to buffer. */
 static struct evbuffer *
 control_append_data(struct client *c, struct control_pane *cp, uint64_t age,
@@ -506,7 +834,6 @@ control_append_data(struct client *c, struct control_pane *cp, uint64_t age,
 {
 	u_char	*new_data;
 	size_t	 new_size;
-	u_int	 i;
 
 	if (message == NULL) {
 		message = evbuffer_new();
@@ -523,22 +850,44 @@ control_append_data(struct client *c, struct control_pane *cp, uint64_t age,
 	new_data = window_pane_get_new_data(wp, &cp->offset, &new_size);
 	if (new_size < size)
 		fatalx("not enough data: %zu < %zu", new_size, size);
-	for (i = 0; i < size; i++) {
-		if (new_data[i] < ' ' || new_data[i] == '\\')
-			evbuffer_add_printf(message, "\\%03o", new_data[i]);
-		else
-			evbuffer_add_printf(message, "%c", new_data[i]);
-	}
+	if (c->flags & CLIENT_CONTROL_BASE64)
+		evbuffer_add(c->control_state->base64, new_data, size);
+	else
+		control_escape_data(message, new_data, size);
 	window_pane_update_used_data(wp, &cp->offset, size);
 	return (message);
 }
 
+/*
+ * Encode the output gathered for a base64 client into a message. This is done
+ * once the message is complete rather than as each block is added, since
+ * base64 can only be joined together in groups of three bytes.
+ */
+static void
+control_encode_base64(struct evbuffer *message, struct evbuffer *data)
+{
+	size_t	 size = EVBUFFER_LENGTH(data), outlen;
+	char	*out;
+
+	if (size == 0)
+		return;
+	outlen = 4 * ((size + 2) / 3) + 1;
+	out = xmalloc(outlen);
+	if (b64_ntop(EVBUFFER_DATA(data), size, out, outlen) == -1)
+		fatalx("base64 encoding failed");
+	evbuffer_add(message, out, outlen - 1);
+	free(out);
+	evbuffer_drain(data, size);
+}
+
 /* Write buffer. */
 static void
 control_write_data(struct client *c, struct evbuffer *message)
 {
 	struct control_state	*cs = c->control_state;
 
+	if (c->flags & CLIENT_CONTROL_BASE64)
+		control_encode_base64(message, cs->base64);
 	log_debug("%s: %s: %.*s", __func__, c->name,
 	    (int)EVBUFFER_LENGTH(message), EVBUFFER_DATA(message));
 
@@ -573,6 +922,7 @@ control_write_pending(struct client *c, struct control_pane *cp, size_t limit)
 			if (message != NULL)
 				evbuffer_free(message);
 			message = NULL;
+			evbuffer_drain(cs->base64, EVBUFFER_LENGTH(cs->base64));
 			break;
 		}
 
@@ -612,6 +962,46 @@ control_write_pending(struct client *c, struct control_pane *cp, size_t limit)
 	return (!TAILQ_EMPTY(&cp->blocks));
 }
 
+/*
+ * Work out the high watermark from how quickly the client wrote the buffer
+ * since it was last filled, so there is enough to last it a little while.
+ */
+static void
+control_update_rate(struct control_state *cs, size_t length, uint64_t t)
+{
+	size_t		 drained, rate, high;
+	uint64_t	 elapsed;
+
+	if (cs->fill_size == 0)
+		return;
+	drained = cs->fill_size > length ? cs->fill_size - length : 0;
+	elapsed = t > cs->fill_time ? t - cs->fill_time : 1;
+	cs->fill_size = 0;
+
+	rate = drained * 1000 / elapsed;
+	if (cs->rate == 0)
+		cs->rate = rate;
+	else
+		cs->rate = (cs->rate * 3 + rate) / 4;
+
+	high = cs->rate / (1000 / CONTROL_BUFFER_TIME);
+	if (high < CONTROL_BUFFER_HIGH)
+		high = CONTROL_BUFFER_HIGH;
+	if (high > CONTROL_BUFFER_MAXIMUM)
+		high = CONTROL_BUFFER_MAXIMUM;
+	cs->high = high;
+}
+
+/* Rate limit timer, fired when a rate limited pane has more tokens. */
+static void
+control_rate_timer(__unused int fd, __unused short events, void *data)
+{
+	struct client		*c = data;
+	struct control_state	*cs = c->control_state;
+
+	bufferevent_enable(cs->write_event, EV_WRITE);
+}
+
 /* Control client write callback. */
 static void
 control_write_callback(__unused struct bufferevent *bufev, void *data)
@@ -620,30 +1010,71 @@ control_write_callback(__unused struct bufferevent *bufev, void *data)
 	struct control_state	*cs = c->control_state;
 	struct control_pane	*cp, *cp1;
 	struct evbuffer		*evb = cs->write_event->output;
-	size_t			 space, limit;
+	struct timeval		 tv;
+	size_t			 space, limit, tokens, used;
+	uint64_t		 t = get_timer(), delay, next = 0;
+	int			 more, progress;
 
+	control_update_rate(cs, EVBUFFER_LENGTH(evb), t);
 	control_flush_all_blocks(c);
 
-	while (EVBUFFER_LENGTH(evb) < CONTROL_BUFFER_HIGH) {
+	while (EVBUFFER_LENGTH(evb) < cs->high) {
 		if (cs->pending_count == 0)
 			break;
-		space = CONTROL_BUFFER_HIGH - EVBUFFER_LENGTH(evb);
+		space = cs->high - EVBUFFER_LENGTH(evb);
 		log_debug("%s: %s: %zu bytes available, %u panes", __func__,
 		    c->name, space, cs->pending_count);
 
-		limit = (space / cs->pending_count / 3); /* 3 bytes for \xxx */
+		if (c->flags & CLIENT_CONTROL_BASE64)
+			limit = (space / cs->pending_count / 4) * 3;
+		else
+			limit = (space / cs->pending_count / 3); /* \xxx */
 		if (limit < CONTROL_WRITE_MINIMUM)
 			limit = CONTROL_WRITE_MINIMUM;
 
+		progress = 0;
 		TAILQ_FOREACH_SAFE(cp, &cs->pending_list, pending_entry, cp1) {
-			if (EVBUFFER_LENGTH(evb) >= CONTROL_BUFFER_HIGH)
+			if (EVBUFFER_LENGTH(evb) >= cs->high)
 				break;
-			if (control_write_pending(c, cp, limit))
+
+			/* Wait until a rate limited pane has enough tokens. */
+			tokens = control_pane_tokens(cp, t);
+			if (tokens < CONTROL_WRITE_MINIMUM) {
+				delay = (CONTROL_WRITE_MINIMUM - tokens) * 1000;
+				delay = 1 + delay / cp->rate;
+				if (next == 0 || delay < next)
+					next = delay;
+				continue;
+			}
+
+			used = cp->offset.used;
+			more = control_write_pending(c, cp,
+			    limit < tokens ? limit : tokens);
+			used = cp->offset.used - used;
+			if (cp->rate != 0)
+				cp->tokens -= used < tokens ? used : tokens;
+			if (used != 0)
+				progress = 1;
+			if (more)
 				continue;
 			TAILQ_REMOVE(&cs->pending_list, cp, pending_entry);
 			cp->pending_flag = 0;
 			cs->pending_count--;
+			progress = 1;
 		}
+		if (!progress)
+			break;
+	}
+	if (next != 0) {
+		cs->limited++;
+		tv.tv_sec = next / 1000;
+		tv.tv_usec = (next % 1000) * 1000;
+		evtimer_add(&cs->rate_timer, &tv);
+	}
+
+	if (EVBUFFER_LENGTH(evb) >= cs->high) {
+		cs->fill_size = EVBUFFER_LENGTH(evb);
+		cs->fill_time = t;
 	}
 	if (EVBUFFER_LENGTH(evb) == 0)
 		bufferevent_disable(cs->write_event, EV_WRITE);
@@ -667,6 +1098,14 @@ control_start(struct client *c)
 	TAILQ_INIT(&cs->pending_list);
 	TAILQ_INIT(&cs->all_blocks);
 
+	cs->base64 = evbuffer_new();
+	if (cs->base64 == NULL)
+		fatalx("out of memory");
+
+	cs->high = CONTROL_BUFFER_HIGH;
+	evtimer_set(&cs->rate_timer, control_rate_timer, c);
+	evtimer_set(&cs->screen_timer, control_screen_timer, c);
+
 	cs->read_event = bufferevent_new(c->fd, control_read_callback,
 	    control_write_callback, control_error_callback, c);
 	bufferevent_enable(cs->read_event, EV_READ);
@@ -708,10 +1147,13 @@ control_stop(struct client *c)
 	if (~c->flags & CLIENT_CONTROLCONTROL)
 		bufferevent_free(cs->write_event);
 	bufferevent_free(cs->read_event);
+	evtimer_del(&cs->rate_timer);
+	evtimer_del(&cs->screen_timer);
 
 	TAILQ_FOREACH_SAFE(cb, &cs->all_blocks, all_entry, cb1)
 		control_free_block(cs, cb);
 	control_reset_offsets(c);
 
+	evbuffer_free(cs->base64);
 	free(cs);
 }
@@ -38,10 +38,12 @@
  * string.
  */
 
+struct format_expr;
+
 static char	*format_job_get(struct format_tree *, const char *);
 static void	 format_job_timer(int, short, void *);
 
-static int	 format_replace(struct format_tree *, const char *, size_t,
+static int	 format_replace(struct format_tree *, struct format_expr *,
 		     char **, size_t *, size_t *);
 static void	 format_defaults_session(struct format_tree *,
 		     struct session *);
@@ -104,9 +106,25 @@ struct format_entry {
 	char			*value;
 	time_t			 t;
 	format_cb		 cb;
+	struct format_memos	*memos;
 	RB_ENTRY(format_entry)	 entry;
 };
 
+/*
+ * Remembered value of a callback. The memos for an object are freed when it
+ * changes and all memos are out of date when the generation changes.
+ */
+struct format_memo {
+	char			*key;
+	char			*value;
+	u_int			 generation;
+
+	RB_ENTRY(format_memo)	 entry;
+};
+static u_int format_memo_generation;
+static int format_memo_cmp(struct format_memo *, struct format_memo *);
+RB_GENERATE_STATIC(format_memos, format_memo, entry, format_memo_cmp);
+
 /* Format entry tree. */
 struct format_tree {
 	struct client		*c;
@@ -138,6 +156,76 @@ struct format_modifier {
 	int	  argc;
 };
 
+/*
+ * Compiled #{} expression. The modifier arguments are stored unexpanded and
+ * expanded each time the expression is used if they contain any formats. The
+ * key (or the condition if it is a conditional) is parsed as an option name
+ * and split into alternatives once.
+ */
+struct format_expr {
+	char			*text;
+	const char		*key;
+
+	struct format_modifier	*list;
+	u_int			 count;
+	int			 expand;
+
+	char			*option;
+	int			 idx;
+
+	char			*left;
+	char			*right;
+
+	char			*condition;
+	char			*true_value;
+	char			*false_value;
+};
+
+/* Part of a compiled template. */
+enum format_part_type {
+	FORMAT_PART_TEXT,
+	FORMAT_PART_JOB,
+	FORMAT_PART_EXPR
+};
+struct format_part {
+	enum format_part_type	 type;
+	char			*text;
+	size_t			 size;
+	struct format_expr	 expr;
+};
+
+/*
+ * Compiled template. Templates are split into parts once and kept in a tree
+ * by their text, so expanding the same template again only needs to walk the
+ * parts. The compiled form depends only on the text so is never out of date;
+ * the tree is emptied when it gets too big.
+ */
+struct format_template {
+	char				*fmt;
+	struct format_part		*parts;
+	u_int				 nparts;
+
+	RB_ENTRY(format_template)	 entry;
+};
+#define FORMAT_TEMPLATE_LIMIT 1000
+
+/* Format template tree. */
+static u_int format_templates_count;
+static u_int format_templates_used;
+static int format_template_cmp(struct format_template *,
+    struct format_template *);
+static RB_HEAD(format_template_tree, format_template) format_templates =
+    RB_INITIALIZER();
+RB_GENERATE_STATIC(format_template_tree, format_template, entry,
+    format_template_cmp);
+
+/* Format template tree comparison function. */
+static int
+format_template_cmp(struct format_template *ft1, struct format_template *ft2)
+{
+	return (strcmp(ft1->fmt, ft2->fmt));
+}
+
 /* Format entry tree comparison function. */
 static int
 format_entry_cmp(struct format_entry *fe1, struct format_entry *fe2)
@@ -145,6 +233,13 @@ format_entry_cmp(struct format_entry *fe1, struct format_entry *fe2)
 	return (strcmp(fe1->key, fe2->key));
 }
 
+/* Format memo tree comparison function. */
+static int
+format_memo_cmp(struct format_memo *memo1, struct format_memo *memo2)
+{
+	return (strcmp(memo1->key, memo2->key));
+}
+
 /* Single-character uppercase aliases. */
 static const char *format_upper[] = {
 	NULL,		/* A */
@@ -730,7 +825,7 @@ format_cb_current_command(struct format_tree *ft)
 	if (wp == NULL || wp->shell == NULL)
 		return (NULL);
 
-	cmd = osdep_get_name(wp->fd, wp->tty);
+	cmd = window_pane_get_name(wp);
 	if (cmd == NULL || *cmd == '\0') {
 		free(cmd);
 		cmd = cmd_stringify_argv(wp->argc, wp->argv);
@@ -749,12 +844,12 @@ static char *
 format_cb_current_path(struct format_tree *ft)
 {
 	struct window_pane	*wp = ft->wp;
-	char			*cwd;
+	const char		*cwd;
 
 	if (wp == NULL)
 		return (NULL);
 
-	cwd = osdep_get_cwd(wp->fd);
+	cwd = window_pane_get_cwd(wp);
 	if (cwd == NULL)
 		return (NULL);
 	return (xstrdup(cwd));
@@ -767,19 +862,18 @@ format_cb_history_bytes(struct format_tree *ft)
 	struct window_pane	*wp = ft->wp;
 	struct grid		*gd;
 	struct grid_line	*gl;
-	size_t		         size = 0;
-	u_int			 i;
+	size_t		         size, packed;
+	u_int			 cells, extended_cells;
 	char			*value;
 
 	if (wp == NULL)
 		return (NULL);
 	gd = wp->base.grid;
 
-	for (i = 0; i < gd->hsize + gd->sy; i++) {
-		gl = grid_get_line(gd, i);
-		size += gl->cellsize * sizeof *gl->celldata;
-		size += gl->extdsize * sizeof *gl->extddata;
-	}
+	grid_get_size(gd, &cells, &extended_cells, &packed);
+	size = cells * sizeof *gl->celldata;
+	size += extended_cells * sizeof *gl->extddata;
+	size += packed;
 	size += (gd->hsize + gd->sy) * sizeof *gl;
 
 	xasprintf(&value, "%zu", size);
@@ -793,7 +887,8 @@ format_cb_history_all_bytes(struct format_tree *ft)
 	struct window_pane	*wp = ft->wp;
 	struct grid		*gd;
 	struct grid_line	*gl;
-	u_int			 i, lines, cells = 0, extended_cells = 0;
+	u_int			 lines, cells, extended_cells;
+	size_t			 packed;
 	char			*value;
 
 	if (wp == NULL)
@@ -801,15 +896,28 @@ format_cb_history_all_bytes(struct format_tree *ft)
 	gd = wp->base.grid;
 
 	lines = gd->hsize + gd->sy;
-	for (i = 0; i < lines; i++) {
-		gl = grid_get_line(gd, i);
-		cells += gl->cellsize;
-		extended_cells += gl->extdsize;
-	}
+	grid_get_size(gd, &cells, &extended_cells, &packed);
 
-	xasprintf(&value, "%u,%zu,%u,%zu,%u,%zu", lines,
+	xasprintf(&value, "%u,%zu,%u,%zu,%u,%zu,%zu", lines,
 	    lines * sizeof *gl, cells, cells * sizeof *gl->celldata,
-	    extended_cells, extended_cells * sizeof *gl->extddata);
+	    extended_cells, extended_cells * sizeof *gl->extddata, packed);
+	return (value);
+}
+
+/* Callback for history_arena. */
+static char *
+format_cb_history_arena(struct format_tree *ft)
+{
+	struct window_pane	*wp = ft->wp;
+	u_int			 slabs;
+	size_t			 allocated, used;
+	char			*value;
+
+	if (wp == NULL)
+		return (NULL);
+
+	grid_arena_get_size(wp->base.grid->arena, &slabs, &allocated, &used);
+	xasprintf(&value, "%u,%zu,%zu", slabs, allocated, used);
 	return (value);
 }
 
@@ -1294,6 +1402,7 @@ format_add(struct format_tree *ft, const char *key, const char *fmt, ...)
 	}
 
 	fe->cb = NULL;
+	fe->memos = NULL;
 	fe->t = 0;
 
 	va_start(ap, fmt);
@@ -1319,6 +1428,7 @@ format_add_tv(struct format_tree *ft, const char *key, struct timeval *tv)
 	}
 
 	fe->cb = NULL;
+	fe->memos = NULL;
 	fe->t = tv->tv_sec;
 
 	fe->value = NULL;
@@ -1343,11 +1453,75 @@ format_add_cb(struct format_tree *ft, const char *key, format_cb cb)
 	}
 
 	fe->cb = cb;
+	fe->memos = NULL;
 	fe->t = 0;
 
 	fe->value = NULL;
 }
 
+/*
+ * Add a key and function whose value is remembered in the memos of an object
+ * until it changes.
+ */
+static void
+format_add_memo_cb(struct format_tree *ft, const char *key, format_cb cb,
+    struct format_memos *memos)
+{
+	struct format_entry	*fe, fe_find;
+
+	format_add_cb(ft, key, cb);
+
+	fe_find.key = (char *)key;
+	fe = RB_FIND(format_entry_tree, &ft->tree, &fe_find);
+	fe->memos = memos;
+}
+
+/* Get a value from memos or call the function and remember it. */
+static char *
+format_get_memo(struct format_tree *ft, struct format_entry *fe)
+{
+	struct format_memo	*memo, memo_find;
+
+	memo_find.key = fe->key;
+	memo = RB_FIND(format_memos, fe->memos, &memo_find);
+	if (memo == NULL) {
+		memo = xcalloc(1, sizeof *memo);
+		memo->key = xstrdup(fe->key);
+		RB_INSERT(format_memos, fe->memos, memo);
+	} else if (memo->generation == format_memo_generation) {
+		format_log(ft, "memo '%s' used", fe->key);
+		return (xstrdup(memo->value));
+	}
+
+	free(memo->value);
+	memo->value = fe->cb(ft);
+	if (memo->value == NULL)
+		memo->value = xstrdup("");
+	memo->generation = format_memo_generation;
+	return (xstrdup(memo->value));
+}
+
+/* Free memos, called when their object changes. */
+void
+format_free_memos(struct format_memos *memos)
+{
+	struct format_memo	*memo, *memo1;
+
+	RB_FOREACH_SAFE(memo, format_memos, memos, memo1) {
+		RB_REMOVE(format_memos, memos, memo);
+		free(memo->value);
+		free(memo->key);
+		free(memo);
+	}
+}
+
+/* Make all memos out of date. */
+void
+format_invalidate_memos(void)
+{
+	format_memo_generation++;
+}
+
 /* Quote special characters in string. */
 static char *
 format_quote(const char *s)
@@ -1413,29 +1587,30 @@ format_pretty_time(time_t t)
 
 /* Find a format entry. */
 static char *
-format_find(struct format_tree *ft, const char *key, int modifiers,
-    const char *time_format)
+format_find(struct format_tree *ft, const char *key, const char *option,
+    int idx, int modifiers, const char *time_format)
 {
 	struct format_entry	*fe, fe_find;
 	struct environ_entry	*envent;
-	struct options_entry	*o;
-	int			 idx;
+	struct options_entry	*o = NULL;
 	char			*found = NULL, *saved, s[512];
 	const char		*errstr;
 	time_t			 t = 0;
 	struct tm		 tm;
 
-	o = options_parse_get(global_options, key, &idx, 0);
-	if (o == NULL && ft->wp != NULL)
-		o = options_parse_get(ft->wp->options, key, &idx, 0);
-	if (o == NULL && ft->w != NULL)
-		o = options_parse_get(ft->w->options, key, &idx, 0);
-	if (o == NULL)
-		o = options_parse_get(global_w_options, key, &idx, 0);
-	if (o == NULL && ft->s != NULL)
-		o = options_parse_get(ft->s->options, key, &idx, 0);
-	if (o == NULL)
-		o = options_parse_get(global_s_options, key, &idx, 0);
+	if (option != NULL) {
+		o = options_get(global_options, option);
+		if (o == NULL && ft->wp != NULL)
+			o = options_get(ft->wp->options, option);
+		if (o == NULL && ft->w != NULL)
+			o = options_get(ft->w->options, option);
+		if (o == NULL)
+			o = options_get(global_w_options, option);
+		if (o == NULL && ft->s != NULL)
+			o = options_get(ft->s->options, option);
+		if (o == NULL)
+			o = options_get(global_s_options, option);
+	}
 	if (o != NULL) {
 		found = options_to_string(o, idx, 1);
 		goto found;
@@ -1448,7 +1623,9 @@ format_find(struct format_tree *ft, const char *key, int modifiers,
 			t = fe->t;
 			goto found;
 		}
-		if (fe->value == NULL && fe->cb != NULL) {
+		if (fe->value == NULL && fe->memos != NULL)
+			fe->value = format_get_memo(ft, fe);
+		else if (fe->value == NULL && fe->cb != NULL) {
 			fe->value = fe->cb(ft);
 			if (fe->value == NULL)
 				fe->value = xstrdup("");
@@ -1565,32 +1742,6 @@ format_skip(const char *s, const char *end)
 	return (s);
 }
 
-/* Return left and right alternatives separated by commas. */
-static int
-format_choose(struct format_tree *ft, const char *s, char **left, char **right,
-    int expand)
-{
-	const char	*cp;
-	char		*left0, *right0;
-
-	cp = format_skip(s, ",");
-	if (cp == NULL)
-		return (-1);
-	left0 = xstrndup(s, cp - s);
-	right0 = xstrdup(cp + 1);
-
-	if (expand) {
-		*left = format_expand(ft, left0);
-		free(left0);
-		*right = format_expand(ft, right0);
-		free(right0);
-	} else {
-		*left = left0;
-		*right = right0;
-	}
-	return (0);
-}
-
 /* Is this true? */
 int
 format_true(const char *s)
@@ -1636,9 +1787,12 @@ format_free_modifiers(struct format_modifier *list, u_int count)
 	free(list);
 }
 
-/* Build modifier list. */
+/*
+ * Build modifier list. The arguments are not expanded; expand is set if any
+ * of them need to be.
+ */
 static struct format_modifier *
-format_build_modifiers(struct format_tree *ft, const char **s, u_int *count)
+format_build_modifiers(const char **s, u_int *count, int *expand)
 {
 	const char		*cp = *s, *end;
 	struct format_modifier	*list = NULL;
@@ -1657,6 +1811,7 @@ format_build_modifiers(struct format_tree *ft, const char **s, u_int *count)
 	 */
 
 	*count = 0;
+	*expand = 0;
 
 	while (*cp != '\0' && *cp != ':') {
 		/* Skip any separator character. */
@@ -1706,8 +1861,9 @@ format_build_modifiers(struct format_tree *ft, const char **s, u_int *count)
 
 			argv = xcalloc(1, sizeof *argv);
 			value = xstrndup(cp + 1, end - (cp + 1));
-			argv[0] = format_expand(ft, value);
-			free(value);
+			if (strchr(value, '#') != NULL)
+				*expand = 1;
+			argv[0] = value;
 			argc = 1;
 
 			format_add_modifier(&list, count, &c, 1, argv, argc);
@@ -1730,8 +1886,9 @@ format_build_modifiers(struct format_tree *ft, const char **s, u_int *count)
 
 			argv = xreallocarray (argv, argc + 1, sizeof *argv);
 			value = xstrndup(cp, end - cp);
-			argv[argc++] = format_expand(ft, value);
-			free(value);
+			if (strchr(value, '#') != NULL)
+				*expand = 1;
+			argv[argc++] = value;
 
 			cp = end;
 		} while (!format_is_end(cp[0]));
@@ -1746,6 +1903,262 @@ format_build_modifiers(struct format_tree *ft, const char **s, u_int *count)
 	return (list);
 }
 
+/* Expand modifier arguments, returning the compiled list if none need it. */
+static struct format_modifier *
+format_expand_modifiers(struct format_tree *ft, struct format_expr *expr)
+{
+	struct format_modifier	*list, *fm;
+	u_int			 i;
+	int			 j;
+
+	if (!expr->expand)
+		return (expr->list);
+
+	list = xreallocarray(NULL, expr->count, sizeof *list);
+	for (i = 0; i < expr->count; i++) {
+		fm = &list[i];
+		memcpy(fm, &expr->list[i], sizeof *fm);
+		if (fm->argc == 0)
+			continue;
+		fm->argv = xreallocarray(NULL, fm->argc, sizeof *fm->argv);
+		for (j = 0; j < fm->argc; j++)
+			fm->argv[j] = format_expand(ft, expr->list[i].argv[j]);
+	}
+	return (list);
+}
+
+/* Split a string into left and right alternatives separated by a comma. */
+static int
+format_choose(const char *s, char **left, char **right)
+{
+	const char	*cp;
+
+	cp = format_skip(s, ",");
+	if (cp == NULL)
+		return (-1);
+	*left = xstrndup(s, cp - s);
+	*right = xstrdup(cp + 1);
+	return (0);
+}
+
+/*
+ * Parse a key as an option name. Only table options and user options can
+ * exist, so other names are not looked for in the options at all.
+ */
+static char *
+format_parse_option(const char *key, int *idx)
+{
+	const struct options_table_entry	*oe;
+	char					*name;
+
+	name = options_parse(key, idx);
+	if (name == NULL || *name == '@')
+		return (name);
+	for (oe = options_table; oe->name != NULL; oe++) {
+		if (strcmp(oe->name, name) == 0)
+			return (name);
+	}
+	free(name);
+	return (NULL);
+}
+
+/* Compile a #{} expression. */
+static void
+format_compile_expr(struct format_expr *expr, const char *key, size_t keylen)
+{
+	const char	*copy, *cp;
+
+	expr->text = xstrndup(key, keylen);
+
+	copy = expr->text;
+	expr->list = format_build_modifiers(&copy, &expr->count, &expr->expand);
+	expr->key = copy;
+
+	format_choose(copy, &expr->left, &expr->right);
+	if (*copy == '?' && (cp = format_skip(copy + 1, ",")) != NULL) {
+		expr->condition = xstrndup(copy + 1, cp - (copy + 1));
+		format_choose(cp + 1, &expr->true_value, &expr->false_value);
+		expr->option = format_parse_option(expr->condition,
+		    &expr->idx);
+	} else
+		expr->option = format_parse_option(copy, &expr->idx);
+}
+
+/* Free a compiled #{} expression. */
+static void
+format_free_expr(struct format_expr *expr)
+{
+	format_free_modifiers(expr->list, expr->count);
+	free(expr->option);
+	free(expr->left);
+	free(expr->right);
+	free(expr->condition);
+	free(expr->true_value);
+	free(expr->false_value);
+	free(expr->text);
+}
+
+/* Add a part to a template. */
+static struct format_part *
+format_add_part(struct format_template *fte, enum format_part_type type)
+{
+	struct format_part	*fp;
+
+	fte->parts = xreallocarray(fte->parts, fte->nparts + 1,
+	    sizeof *fte->parts);
+	fp = &fte->parts[fte->nparts++];
+	memset(fp, 0, sizeof *fp);
+	fp->type = type;
+	return (fp);
+}
+
+/* Add text to a template, joining it to the last part if that is text. */
+static void
+format_add_text(struct format_template *fte, const char *text, size_t size)
+{
+	struct format_part	*fp;
+
+	if (fte->nparts != 0 &&
+	    fte->parts[fte->nparts - 1].type == FORMAT_PART_TEXT)
+		fp = &fte->parts[fte->nparts - 1];
+	else
+		fp = format_add_part(fte, FORMAT_PART_TEXT);
+	fp->text = xrealloc(fp->text, fp->size + size + 1);
+	memcpy(fp->text + fp->size, text, size);
+	fp->size += size;
+	fp->text[fp->size] = '\0';
+}
+
+/*
+ * Compile a template into parts. Anything after a syntax error is left out,
+ * as it would not be expanded.
+ */
+static struct format_template *
+format_compile(const char *fmt)
+{
+	struct format_template	*fte;
+	struct format_part	*fp;
+	const char		*ptr, *s;
+	size_t			 n;
+	int			 ch, brackets;
+
+	fte = xcalloc(1, sizeof *fte);
+	fte->fmt = xstrdup(fmt);
+
+	while (*fmt != '\0') {
+		if (*fmt != '#') {
+			n = strcspn(fmt, "#");
+			format_add_text(fte, fmt, n);
+			fmt += n;
+			continue;
+		}
+		fmt++;
+
+		ch = (u_char)*fmt++;
+		switch (ch) {
+		case '(':
+			brackets = 1;
+			for (ptr = fmt; *ptr != '\0'; ptr++) {
+				if (*ptr == '(')
+					brackets++;
+				if (*ptr == ')' && --brackets == 0)
+					break;
+			}
+			if (*ptr != ')' || brackets != 0)
+				break;
+			n = ptr - fmt;
+
+			fp = format_add_part(fte, FORMAT_PART_JOB);
+			fp->text = xstrndup(fmt, n);
+			fp->size = n;
+
+			fmt += n + 1;
+			continue;
+		case '{':
+			ptr = format_skip((char *)fmt - 2, "}");
+			if (ptr == NULL)
+				break;
+			n = ptr - fmt;
+
+			fp = format_add_part(fte, FORMAT_PART_EXPR);
+			format_compile_expr(&fp->expr, fmt, n);
+
+			fmt += n + 1;
+			continue;
+		case '}':
+		case '#':
+		case ',':
+			format_add_text(fte, fmt - 1, 1);
+			continue;
+		case '\0':
+			format_add_text(fte, "#", 1);
+			break;
+		default:
+			s = NULL;
+			if (ch >= 'A' && ch <= 'Z')
+				s = format_upper[ch - 'A'];
+			else if (ch >= 'a' && ch <= 'z')
+				s = format_lower[ch - 'a'];
+			if (s == NULL) {
+				format_add_text(fte, fmt - 2, 2);
+				continue;
+			}
+			fp = format_add_part(fte, FORMAT_PART_EXPR);
+			format_compile_expr(&fp->expr, s, strlen(s));
+			continue;
+		}
+
+		break;
+	}
+	return (fte);
+}
+
+/* Free a compiled template. */
+static void
+format_free_template(struct format_template *fte)
+{
+	struct format_part	*fp;
+	u_int			 i;
+
+	for (i = 0; i < fte->nparts; i++) {
+		fp = &fte->parts[i];
+		free(fp->text);
+		if (fp->type == FORMAT_PART_EXPR)
+			format_free_expr(&fp->expr);
+	}
+	free(fte->parts);
+	free(fte->fmt);
+	free(fte);
+}
+
+/* Find a compiled template or compile and add it. */
+static struct format_template *
+format_get_template(const char *fmt)
+{
+	struct format_template	 find, *fte, *fte1;
+
+	find.fmt = (char *)fmt;
+	if ((fte = RB_FIND(format_template_tree, &format_templates,
+	    &find)) != NULL)
+		return (fte);
+
+	/* Only empty the tree if no templates are being expanded. */
+	if (format_templates_used == 0 &&
+	    format_templates_count >= FORMAT_TEMPLATE_LIMIT) {
+		RB_FOREACH_SAFE(fte, format_template_tree, &format_templates,
+		    fte1) {
+			RB_REMOVE(format_template_tree, &format_templates, fte);
+			format_free_template(fte);
+		}
+		format_templates_count = 0;
+	}
+
+	fte = format_compile(fmt);
+	RB_INSERT(format_template_tree, &format_templates, fte);
+	format_templates_count++;
+	return (fte);
+}
+
 /* Match against an fnmatch(3) pattern or regular expression. */
 static char *
 format_match(struct format_modifier *fm, const char *pattern, const char *text)
@@ -1858,7 +2271,7 @@ format_loop_windows(struct format_tree *ft, const char *fmt)
 		return (NULL);
 	}
 
-	if (format_choose(ft, fmt, &all, &active, 0) != 0) {
+	if (format_choose(fmt, &all, &active) != 0) {
 		all = xstrdup(fmt);
 		active = NULL;
 	}
@@ -1908,7 +2321,7 @@ format_loop_panes(struct format_tree *ft, const char *fmt)
 		return (NULL);
 	}
 
-	if (format_choose(ft, fmt, &all, &active, 0) != 0) {
+	if (format_choose(fmt, &all, &active) != 0) {
 		all = xstrdup(fmt);
 		active = NULL;
 	}
@@ -1943,7 +2356,7 @@ format_loop_panes(struct format_tree *ft, const char *fmt)
 
 static char *
 format_replace_expression(struct format_modifier *mexp, struct format_tree *ft,
-    const char *copy)
+    struct format_expr *expr)
 {
 	int		 argc = mexp->argc;
 	const char	*errstr;
@@ -1986,10 +2399,12 @@ format_replace_expression(struct format_modifier *mexp, struct format_tree *ft,
 		}
 	}
 
-	if (format_choose(ft, copy, &left, &right, 1) != 0) {
+	if (expr->left == NULL) {
 		format_log(ft, "expression syntax error");
 		goto fail;
 	}
+	left = format_expand(ft, expr->left);
+	right = format_expand(ft, expr->right);
 
 	mleft = strtod(left, &endch);
 	if (*endch != '\0') {
@@ -2045,25 +2460,22 @@ fail:
 
 /* Replace a key. */
 static int
-format_replace(struct format_tree *ft, const char *key, size_t keylen,
-    char **buf, size_t *len, size_t *off)
+format_replace(struct format_tree *ft, struct format_expr *expr, char **buf,
+    size_t *len, size_t *off)
 {
 	struct window_pane	 *wp = ft->wp;
-	const char		 *errptr, *copy, *cp, *marker = NULL;
-	const char		 *time_format = NULL;
-	char			 *copy0, *condition, *found, *new;
+	const char		 *errptr, *copy = expr->key, *marker = NULL;
+	const char		 *condition, *time_format = NULL;
+	char			 *found, *new;
 	char			 *value, *left, *right;
 	size_t			  valuelen;
 	int			  modifiers = 0, limit = 0, width = 0, j;
 	struct format_modifier   *list, *fm, *cmp = NULL, *search = NULL;
 	struct format_modifier	**sub = NULL, *mexp = NULL;
-	u_int			  i, count, nsub = 0;
-
-	/* Make a copy of the key. */
-	copy = copy0 = xstrndup(key, keylen);
+	u_int			  i, count = expr->count, nsub = 0;
 
 	/* Process modifier list. */
-	list = format_build_modifiers(ft, &copy, &count);
+	list = format_expand_modifiers(ft, expr);
 	for (i = 0; i < count; i++) {
 		fm = &list[i];
 		if (format_logging(ft)) {
@@ -2194,11 +2606,13 @@ format_replace(struct format_tree *ft, const char *key, size_t keylen,
 		free(new);
 	} else if (cmp != NULL) {
 		/* Comparison of left and right. */
-		if (format_choose(ft, copy, &left, &right, 1) != 0) {
+		if (expr->left == NULL) {
 			format_log(ft, "compare %s syntax error: %s",
 			    cmp->modifier, copy);
 			goto fail;
 		}
+		left = format_expand(ft, expr->left);
+		right = format_expand(ft, expr->right);
 		format_log(ft, "compare %s left is: %s", cmp->modifier, left);
 		format_log(ft, "compare %s right is: %s", cmp->modifier, right);
 
@@ -2249,15 +2663,15 @@ format_replace(struct format_tree *ft, const char *key, size_t keylen,
 		free(left);
 	} else if (*copy == '?') {
 		/* Conditional: check first and choose second or third. */
-		cp = format_skip(copy + 1, ",");
-		if (cp == NULL) {
+		condition = expr->condition;
+		if (condition == NULL) {
 			format_log(ft, "condition syntax error: %s", copy + 1);
 			goto fail;
 		}
-		condition = xstrndup(copy + 1, cp - (copy + 1));
 		format_log(ft, "condition is: %s", condition);
 
-		found = format_find(ft, condition, modifiers, time_format);
+		found = format_find(ft, condition, expr->option, expr->idx,
+		    modifiers, time_format);
 		if (found == NULL) {
 			/*
 			 * If the condition not found, try to expand it. If
@@ -2278,31 +2692,28 @@ format_replace(struct format_tree *ft, const char *key, size_t keylen,
 		} else
 			format_log(ft, "condition '%s' found", condition);
 
-		if (format_choose(ft, cp + 1, &left, &right, 0) != 0) {
+		if (expr->true_value == NULL) {
 			format_log(ft, "condition '%s' syntax error: %s",
-			    condition, cp + 1);
+			    condition, copy + strlen(condition) + 2);
 			free(found);
 			goto fail;
 		}
 		if (format_true(found)) {
 			format_log(ft, "condition '%s' is true", condition);
-			value = format_expand(ft, left);
+			value = format_expand(ft, expr->true_value);
 		} else {
 			format_log(ft, "condition '%s' is false", condition);
-			value = format_expand(ft, right);
+			value = format_expand(ft, expr->false_value);
 		}
-		free(right);
-		free(left);
-
-		free(condition);
 		free(found);
 	} else if (mexp != NULL) {
-		value = format_replace_expression(mexp, ft, copy);
+		value = format_replace_expression(mexp, ft, expr);
 		if (value == NULL)
 			value = xstrdup("");
 	} else {
 		/* Neither: look up directly. */
-		value = format_find(ft, copy, modifiers, time_format);
+		value = format_find(ft, copy, expr->option, expr->idx,
+		    modifiers, time_format);
 		if (value == NULL) {
 			format_log(ft, "format '%s' not found", copy);
 			value = xstrdup("");
@@ -2380,20 +2791,20 @@ done:
 	memcpy(*buf + *off, value, valuelen);
 	*off += valuelen;
 
-	format_log(ft, "replaced '%s' with '%s'", copy0, value);
+	format_log(ft, "replaced '%s' with '%s'", expr->text, value);
 	free(value);
 
 	free(sub);
-	format_free_modifiers(list, count);
-	free(copy0);
+	if (list != expr->list)
+		format_free_modifiers(list, count);
 	return (0);
 
 fail:
-	format_log(ft, "failed %s", copy0);
+	format_log(ft, "failed %s", expr->text);
 
 	free(sub);
-	format_free_modifiers(list, count);
-	free(copy0);
+	if (list != expr->list)
+		format_free_modifiers(list, count);
 	return (-1);
 }
 
@@ -2401,12 +2812,13 @@ fail:
 static char *
 format_expand1(struct format_tree *ft, const char *fmt, int time)
 {
-	char		*buf, *out, *name;
-	const char	*ptr, *s;
-	size_t		 off, len, n, outlen;
-	int     	 ch, brackets;
-	struct tm	*tm;
-	char		 expanded[8192];
+	struct format_template	*fte;
+	struct format_part	*fp;
+	char			*buf, *out;
+	size_t			 off, len, outlen;
+	struct tm		*tm;
+	char			 expanded[8192];
+	u_int			 i;
 
 	if (fmt == NULL || *fmt == '\0')
 		return (xstrdup(""));
@@ -2428,46 +2840,41 @@ format_expand1(struct format_tree *ft, const char *fmt, int time)
 		fmt = expanded;
 	}
 
+	/* Nothing to expand if there are no #s. */
+	if (strchr(fmt, '#') == NULL) {
+		format_log(ft, "result is: %s", fmt);
+		ft->loop--;
+		return (xstrdup(fmt));
+	}
+
+	fte = format_get_template(fmt);
+	format_templates_used++;
+
 	len = 64;
 	buf = xmalloc(len);
 	off = 0;
 
-	while (*fmt != '\0') {
-		if (*fmt != '#') {
-			while (len - off < 2) {
+	for (i = 0; i < fte->nparts; i++) {
+		fp = &fte->parts[i];
+		switch (fp->type) {
+		case FORMAT_PART_TEXT:
+			while (len - off < fp->size + 1) {
 				buf = xreallocarray(buf, 2, len);
 				len *= 2;
 			}
-			buf[off++] = *fmt++;
+			memcpy(buf + off, fp->text, fp->size);
+			off += fp->size;
 			continue;
-		}
-		fmt++;
-
-		ch = (u_char)*fmt++;
-		switch (ch) {
-		case '(':
-			brackets = 1;
-			for (ptr = fmt; *ptr != '\0'; ptr++) {
-				if (*ptr == '(')
-					brackets++;
-				if (*ptr == ')' && --brackets == 0)
-					break;
-			}
-			if (*ptr != ')' || brackets != 0)
-				break;
-			n = ptr - fmt;
-
-			name = xstrndup(fmt, n);
-			format_log(ft, "found #(): %s", name);
+		case FORMAT_PART_JOB:
+			format_log(ft, "found #(): %s", fp->text);
 
 			if (ft->flags & FORMAT_NOJOBS) {
 				out = xstrdup("");
 				format_log(ft, "#() is disabled");
 			} else {
-				out = format_job_get(ft, name);
+				out = format_job_get(ft, fp->text);
 				format_log(ft, "#() result: %s", out);
 			}
-			free(name);
 
 			outlen = strlen(out);
 			while (len - off < outlen + 1) {
@@ -2478,48 +2885,10 @@ format_expand1(struct format_tree *ft, const char *fmt, int time)
 			off += outlen;
 
 			free(out);
-
-			fmt += n + 1;
-			continue;
-		case '{':
-			ptr = format_skip((char *)fmt - 2, "}");
-			if (ptr == NULL)
-				break;
-			n = ptr - fmt;
-
-			format_log(ft, "found #{}: %.*s", (int)n, fmt);
-			if (format_replace(ft, fmt, n, &buf, &len, &off) != 0)
-				break;
-			fmt += n + 1;
-			continue;
-		case '}':
-		case '#':
-		case ',':
-			format_log(ft, "found #%c", ch);
-			while (len - off < 2) {
-				buf = xreallocarray(buf, 2, len);
-				len *= 2;
-			}
-			buf[off++] = ch;
 			continue;
-		default:
-			s = NULL;
-			if (ch >= 'A' && ch <= 'Z')
-				s = format_upper[ch - 'A'];
-			else if (ch >= 'a' && ch <= 'z')
-				s = format_lower[ch - 'a'];
-			if (s == NULL) {
-				while (len - off < 3) {
-					buf = xreallocarray(buf, 2, len);
-					len *= 2;
-				}
-				buf[off++] = '#';
-				buf[off++] = ch;
-				continue;
-			}
-			n = strlen(s);
-			format_log(ft, "found #%c: %s", ch, s);
-			if (format_replace(ft, s, n, &buf, &len, &off) != 0)
+		case FORMAT_PART_EXPR:
+			format_log(ft, "found #{}: %s", fp->expr.text);
+			if (format_replace(ft, &fp->expr, &buf, &len, &off) != 0)
 				break;
 			continue;
 		}
@@ -2528,6 +2897,8 @@ format_expand1(struct format_tree *ft, const char *fmt, int time)
 	}
 	buf[off] = '\0';
 
+	format_templates_used--;
+
 	format_log(ft, "result is: %s", buf);
 	ft->loop--;
 
@@ -2717,6 +3088,8 @@ format_defaults_client(struct format_tree *ft, struct client *c)
 	struct session	*s;
 	const char	*name;
 	struct tty	*tty = &c->tty;
+	size_t		 rate, high;
+	u_int		 limited;
 
 	if (ft->s == NULL)
 		ft->s = c->session;
@@ -2743,6 +3116,12 @@ format_defaults_client(struct format_tree *ft, struct client *c)
 
 	format_add(ft, "client_written", "%zu", c->written);
 	format_add(ft, "client_discarded", "%zu", c->discarded);
+	if (c->flags & CLIENT_CONTROL) {
+		control_get_flow(c, &rate, &high, &limited);
+		format_add(ft, "client_control_rate", "%zu", rate);
+		format_add(ft, "client_control_buffer", "%zu", high);
+		format_add(ft, "client_control_limited", "%u", limited);
+	}
 
 	name = server_client_get_key_table(c);
 	if (strcmp(c->keytable->name, name) == 0)
@@ -2868,8 +3247,12 @@ format_defaults_pane(struct format_tree *ft, struct window_pane *wp)
 
 	format_add(ft, "history_size", "%u", gd->hsize);
 	format_add(ft, "history_limit", "%u", gd->hlimit);
-	format_add_cb(ft, "history_bytes", format_cb_history_bytes);
-	format_add_cb(ft, "history_all_bytes", format_cb_history_all_bytes);
+	format_add_memo_cb(ft, "history_bytes", format_cb_history_bytes,
+	    &wp->memos);
+	format_add_memo_cb(ft, "history_all_bytes",
+	    format_cb_history_all_bytes, &wp->memos);
+	format_add_memo_cb(ft, "history_arena", format_cb_history_arena,
+	    &wp->memos);
 
 	format_add(ft, "pane_written", "%zu", wp->written);
 	format_add(ft, "pane_skipped", "%zu", wp->skipped);
@@ -2968,7 +3351,7 @@ format_defaults_pane(struct format_tree *ft, struct window_pane *wp)
 	format_add(ft, "mouse_sgr_flag", "%d",
 	    !!(wp->base.mode & MODE_MOUSE_SGR));
 
-	format_add_cb(ft, "pane_tabs", format_cb_pane_tabs);
+	format_add_memo_cb(ft, "pane_tabs", format_cb_pane_tabs, &wp->memos);
 }
 
 /* Set default format keys for paste buffer. */
@@ -0,0 +1,263 @@
+/* $OpenBSD$ */
+
+/*
+ * Copyright (c) 2026 The tmux authors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmux.h"
+
+/*
+ * Arena for the cell and extended cell storage of grid lines. Each grid has
+ * its own arena. Allocations are rounded up to one of a set of size classes
+ * (based on common pane widths, since lines are usually a quarter, half or all
+ * of the width) and taken from slabs of chunks of that size, so lines being
+ * expanded and freed do not fragment the heap. Freed chunks go onto a list for
+ * their size class and are reused; the slabs are only released together when
+ * the arena is destroyed (grid.c moves the remaining lines to a new arena after
+ * clearing history). Allocations bigger than the largest class are passed to
+ * malloc.
+ */
+
+/* Number of chunks in each slab. */
+#define GRID_ARENA_CHUNKS 64
+
+/* Widths (in cells) of the size classes. */
+static const u_int grid_arena_widths[] = {
+	8, 16, 20, 32, 40, 64, 80, 120, 132, 160, 200, 256
+};
+#define GRID_ARENA_CLASSES nitems(grid_arena_widths)
+
+/* Header before each chunk. */
+struct grid_arena_chunk {
+	struct grid_arena_slab	*slab;	/* NULL if not in a slab */
+	size_t			 size;
+};
+
+/* Free chunk. */
+struct grid_arena_free {
+	struct grid_arena_free	*next;
+};
+
+/* Slab of chunks of one size class. */
+struct grid_arena_slab {
+	u_int				 class;
+	u_int				 next;
+
+	LIST_ENTRY(grid_arena_slab)	 entry;
+};
+LIST_HEAD(grid_arena_slabs, grid_arena_slab);
+
+/* Arena. */
+struct grid_arena {
+	struct grid_arena_free	*free[GRID_ARENA_CLASSES];
+	struct grid_arena_slab	*current[GRID_ARENA_CLASSES];
+	struct grid_arena_slabs	 slabs;
+
+	u_int			 nslabs;
+	size_t			 allocated;
+	size_t			 used;
+};
+
+/* Round up to a multiple of the chunk header alignment. */
+#define GRID_ARENA_ROUND(n) \
+	(((n) + sizeof (struct grid_arena_chunk) - 1) & \
+	~(sizeof (struct grid_arena_chunk) - 1))
+
+/* Size of each chunk in a size class, without the header. */
+static size_t
+grid_arena_class_size(u_int class)
+{
+	return (GRID_ARENA_ROUND(grid_arena_widths[class] *
+	    sizeof (struct grid_cell_entry)));
+}
+
+/* Size of a slab of a size class. */
+static size_t
+grid_arena_slab_size(u_int class)
+{
+	size_t	stride;
+
+	stride = sizeof (struct grid_arena_chunk);
+	stride += grid_arena_class_size(class);
+	return (GRID_ARENA_ROUND(sizeof (struct grid_arena_slab)) +
+	    GRID_ARENA_CHUNKS * stride);
+}
+
+/* Find the size class for a size, or -1 if it is too big. */
+static int
+grid_arena_find_class(size_t size)
+{
+	u_int	class;
+
+	for (class = 0; class < GRID_ARENA_CLASSES; class++) {
+		if (size <= grid_arena_class_size(class))
+			return (class);
+	}
+	return (-1);
+}
+
+/* Get a chunk header from a pointer. */
+static struct grid_arena_chunk *
+grid_arena_get_chunk(void *ptr)
+{
+	return ((struct grid_arena_chunk *)ptr - 1);
+}
+
+/* Take a new chunk from the current slab of a class, adding a slab if full. */
+static struct grid_arena_chunk *
+grid_arena_new_chunk(struct grid_arena *ga, u_int class)
+{
+	struct grid_arena_slab	*slab = ga->current[class];
+	struct grid_arena_chunk	*gac;
+	size_t			 stride;
+	u_char			*base;
+
+	if (slab == NULL || slab->next == GRID_ARENA_CHUNKS) {
+		slab = xcalloc(1, grid_arena_slab_size(class));
+		slab->class = class;
+		LIST_INSERT_HEAD(&ga->slabs, slab, entry);
+		ga->current[class] = slab;
+
+		ga->nslabs++;
+		ga->allocated += grid_arena_slab_size(class);
+	}
+
+	stride = sizeof *gac + grid_arena_class_size(class);
+	base = (u_char *)slab + GRID_ARENA_ROUND(sizeof *slab);
+	gac = (struct grid_arena_chunk *)(base + slab->next++ * stride);
+	gac->slab = slab;
+	gac->size = grid_arena_class_size(class);
+	return (gac);
+}
+
+/* Allocate a chunk. */
+static void *
+grid_arena_alloc(struct grid_arena *ga, size_t size)
+{
+	struct grid_arena_chunk	*gac;
+	struct grid_arena_free	*gaf;
+	int			 class;
+
+	class = grid_arena_find_class(size);
+	if (class == -1) {
+		gac = xmalloc(sizeof *gac + size);
+		gac->slab = NULL;
+		gac->size = size;
+		ga->allocated += size;
+	} else if ((gaf = ga->free[class]) != NULL) {
+		ga->free[class] = gaf->next;
+		gac = grid_arena_get_chunk(gaf);
+	} else
+		gac = grid_arena_new_chunk(ga, class);
+
+	ga->used += gac->size;
+	return (gac + 1);
+}
+
+/* Create an arena. */
+struct grid_arena *
+grid_arena_create(void)
+{
+	struct grid_arena	*ga;
+
+	ga = xcalloc(1, sizeof *ga);
+	LIST_INIT(&ga->slabs);
+	return (ga);
+}
+
+/* Destroy an arena and all its slabs. */
+void
+grid_arena_destroy(struct grid_arena *ga)
+{
+	struct grid_arena_slab	*slab, *slab1;
+
+	LIST_FOREACH_SAFE(slab, &ga->slabs, entry, slab1)
+		free(slab);
+	free(ga);
+}
+
+/*
+ * Change the size of an allocation. The chunk is kept if the new size is in
+ * the same size class.
+ */
+void *
+grid_arena_reallocarray(struct grid_arena *ga, void *ptr, size_t nmemb,
+    size_t size)
+{
+	struct grid_arena_chunk	*gac;
+	void			*new;
+	int			 class;
+
+	if (nmemb == 0 || size == 0)
+		fatalx("grid_arena_reallocarray: zero size");
+	if (SIZE_MAX / nmemb < size)
+		fatalx("grid_arena_reallocarray: %zu * %zu too big", nmemb,
+		    size);
+	size *= nmemb;
+
+	if (ptr == NULL)
+		return (grid_arena_alloc(ga, size));
+	gac = grid_arena_get_chunk(ptr);
+
+	class = grid_arena_find_class(size);
+	if (gac->slab != NULL && (int)gac->slab->class == class)
+		return (ptr);
+	if (gac->slab == NULL && class == -1 && size <= gac->size)
+		return (ptr);
+
+	new = grid_arena_alloc(ga, size);
+	memcpy(new, ptr, size < gac->size ? size : gac->size);
+	grid_arena_free(ga, ptr);
+	return (new);
+}
+
+/* Free an allocation. */
+void
+grid_arena_free(struct grid_arena *ga, void *ptr)
+{
+	struct grid_arena_chunk	*gac;
+	struct grid_arena_free	*gaf = ptr;
+	struct grid_arena_slab	*slab;
+
+	if (ptr == NULL)
+		return;
+	gac = grid_arena_get_chunk(ptr);
+	ga->used -= gac->size;
+
+	slab = gac->slab;
+	if (slab == NULL) {
+		ga->allocated -= gac->size;
+		free(gac);
+		return;
+	}
+	gaf->next = ga->free[slab->class];
+	ga->free[slab->class] = gaf;
+}
+
+/* Get the number of slabs, bytes allocated and bytes in use. */
+void
+grid_arena_get_size(struct grid_arena *ga, u_int *slabs, size_t *allocated,
+    size_t *used)
+{
+	*slabs = ga->nslabs;
+	*allocated = ga->allocated;
+	*used = ga->used;
+}
@@ -21,6 +21,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
 #include "tmux.h"
 
 /*
@@ -33,8 +37,56 @@
  * (hsize - 1); from hsize to hsize + (sy - 1) is the viewable data. All
  * functions in this file work on absolute coordinates, grid-view.c has
  * functions which work on the screen data.
+ *
+ * Once history lines are old enough, they are packed together into blocks of
+ * up to GRID_BLOCK_LINES lines. Each cell in a packed line takes about one
+ * byte rather than five (runs of cells with the same attributes share them)
+ * and the block may also be compressed with LZ4. The most recent
+ * GRID_HOT_LINES lines of history are never packed. A packed line is unpacked
+ * again (along with the rest of its block) the first time it is accessed;
+ * unpacked lines will be packed again the next time the history scrolls.
+ * Blocks are reference counted so grid_duplicate_lines can share them.
+ *
+ * Each extended cell holds a reference to its UTF-8 character if it is big
+ * enough to be stored in the UTF-8 table. A packed block holds the references
+ * for the lines packed into it and an unpacked line holds its own.
+ *
+ * The line array is used as a ring: line 0 is at linestart and the lines wrap
+ * around the end of the array. This means that lines can be removed from the
+ * top of a full history and new lines added at the bottom without moving the
+ * remaining lines. grid_raw_line must be used to find a line.
  */
 
+/* Lines in each packed block and lines at the end of history left unpacked. */
+#define GRID_BLOCK_LINES 128
+#define GRID_HOT_LINES 512
+
+/* Packed block of history lines. */
+struct grid_block {
+	u_int		 references;
+
+	u_int		 lines;
+	u_int		 offsets[GRID_BLOCK_LINES];
+
+	size_t		 size;
+	int		 compressed;
+	size_t		 stored;
+	u_char		*data;
+
+	utf8_char	*chars;
+	u_int		 nchars;
+};
+
+/* Packed run of cells, followed by one data byte or one per cell. */
+struct grid_block_run {
+	u_char		 entry[sizeof (struct grid_cell_entry) - 1];
+	u_short		 count;
+#define GRID_BLOCK_RUN_REPEAT 0x8000
+#define GRID_BLOCK_RUN_MAX 0x7fff
+} __packed;
+
+static void	grid_unpack_block(struct grid *, u_int);
+
 /* Default grid cell data. */
 const struct grid_cell grid_default_cell = {
 	{ { ' ' }, 0, 1, 1 }, 0, 0, 8, 8, 0
@@ -95,29 +147,42 @@ grid_need_extended_cell(const struct grid_cell_entry *gce,
 
 /* Get an extended cell. */
 static void
-grid_get_extended_cell(struct grid_line *gl, struct grid_cell_entry *gce,
-    int flags)
+grid_get_extended_cell(struct grid *gd, struct grid_line *gl,
+    struct grid_cell_entry *gce, int flags)
 {
 	u_int at = gl->extdsize + 1;
 
-	gl->extddata = xreallocarray(gl->extddata, at, sizeof *gl->extddata);
+	gl->extddata = grid_arena_reallocarray(gd->arena, gl->extddata, at,
+	    sizeof *gl->extddata);
 	gl->extdsize = at;
 
+	gl->extddata[at - 1].data = 0;
+
 	gce->offset = at - 1;
 	gce->flags = (flags | GRID_FLAG_EXTENDED);
 }
 
+/* Release the UTF-8 characters in a line's extended cells. */
+static void
+grid_release_extended(struct grid_line *gl)
+{
+	u_int	i;
+
+	for (i = 0; i < gl->extdsize; i++)
+		utf8_remove_ref(gl->extddata[i].data);
+}
+
 /* Set cell as extended. */
 static struct grid_extd_entry *
-grid_extended_cell(struct grid_line *gl, struct grid_cell_entry *gce,
-    const struct grid_cell *gc)
+grid_extended_cell(struct grid *gd, struct grid_line *gl,
+    struct grid_cell_entry *gce, const struct grid_cell *gc)
 {
 	struct grid_extd_entry	*gee;
 	int			 flags = (gc->flags & ~GRID_FLAG_CLEARED);
 	utf8_char		 uc;
 
 	if (~gce->flags & GRID_FLAG_EXTENDED)
-		grid_get_extended_cell(gl, gce, flags);
+		grid_get_extended_cell(gd, gl, gce, flags);
 	else if (gce->offset >= gl->extdsize)
 		fatalx("offset too big");
 	gl->flags |= GRID_LINE_EXTENDED;
@@ -125,6 +190,7 @@ grid_extended_cell(struct grid_line *gl, struct grid_cell_entry *gce,
 	utf8_from_data(&gc->data, &uc);
 
 	gee = &gl->extddata[gce->offset];
+	utf8_remove_ref(gee->data);
 	gee->data = uc;
 	gee->attr = gc->attr;
 	gee->flags = flags;
@@ -136,7 +202,7 @@ grid_extended_cell(struct grid_line *gl, struct grid_cell_entry *gce,
 
 /* Free up unused extended cells. */
 static void
-grid_compact_line(struct grid_line *gl)
+grid_compact_line(struct grid *gd, struct grid_line *gl)
 {
 	int			 new_extdsize = 0;
 	struct grid_extd_entry	*new_extddata;
@@ -154,12 +220,14 @@ grid_compact_line(struct grid_line *gl)
 	}
 
 	if (new_extdsize == 0) {
-		free(gl->extddata);
+		grid_release_extended(gl);
+		grid_arena_free(gd->arena, gl->extddata);
 		gl->extddata = NULL;
 		gl->extdsize = 0;
 		return;
 	}
-	new_extddata = xreallocarray(NULL, new_extdsize, sizeof *gl->extddata);
+	new_extddata = grid_arena_reallocarray(gd->arena, NULL, new_extdsize,
+	    sizeof *gl->extddata);
 
 	idx = 0;
 	for (px = 0; px < gl->cellsize; px++) {
@@ -167,42 +235,425 @@ grid_compact_line(struct grid_line *gl)
 		if (gce->flags & GRID_FLAG_EXTENDED) {
 			gee = &gl->extddata[gce->offset];
 			memcpy(&new_extddata[idx], gee, sizeof *gee);
+			gee->data = 0;
 			gce->offset = idx++;
 		}
 	}
 
-	free(gl->extddata);
+	grid_release_extended(gl);
+	grid_arena_free(gd->arena, gl->extddata);
 	gl->extddata = new_extddata;
 	gl->extdsize = new_extdsize;
 }
 
+/* Get a line from the line array, without unpacking it. */
+static struct grid_line *
+grid_raw_line(struct grid *gd, u_int py)
+{
+	u_int	idx = gd->linestart + py;
+
+	if (idx >= gd->linesize)
+		idx -= gd->linesize;
+	return (&gd->linedata[idx]);
+}
+
+/*
+ * Change the size of the line array. Any lines that fit are kept and
+ * line 0 is moved back to the start of the array.
+ */
+static void
+grid_resize_lines(struct grid *gd, u_int size)
+{
+	struct grid_line	*linedata;
+	u_int			 n, first;
+
+	if (gd->linestart == 0 || gd->linedata == NULL) {
+		gd->linedata = xreallocarray(gd->linedata, size,
+		    sizeof *gd->linedata);
+		gd->linesize = size;
+		return;
+	}
+
+	linedata = xreallocarray(NULL, size, sizeof *linedata);
+	n = gd->linesize;
+	if (n > size)
+		n = size;
+	first = gd->linesize - gd->linestart;
+	if (first > n)
+		first = n;
+	memcpy(linedata, &gd->linedata[gd->linestart],
+	    first * sizeof *linedata);
+	memcpy(linedata + first, gd->linedata, (n - first) * sizeof *linedata);
+
+	free(gd->linedata);
+	gd->linedata = linedata;
+	gd->linestart = 0;
+	gd->linesize = size;
+}
+
+/*
+ * Make sure there is space for another line at the end. The array grows by
+ * half each time (up to the history limit, which may be UINT_MAX for modes)
+ * so that once history is full, the ring stays the same size.
+ */
+static void
+grid_reserve_line(struct grid *gd)
+{
+	u_int	need = gd->hsize + gd->sy + 1, size;
+
+	if (need <= gd->linesize)
+		return;
+	size = gd->linesize + gd->linesize / 2;
+	if (gd->hlimit <= UINT_MAX - gd->sy - 1 &&
+	    size > gd->hlimit + gd->sy + 1)
+		size = gd->hlimit + gd->sy + 1;
+	if (size < need)
+		size = need;
+	grid_resize_lines(gd, size);
+}
+
+/* Move lines within the line array, which may overlap. */
+static void
+grid_move_raw_lines(struct grid *gd, u_int dy, u_int py, u_int ny)
+{
+	u_int	yy;
+
+	if (dy < py) {
+		for (yy = 0; yy < ny; yy++) {
+			memcpy(grid_raw_line(gd, dy + yy),
+			    grid_raw_line(gd, py + yy), sizeof *gd->linedata);
+		}
+	} else if (dy > py) {
+		for (yy = ny; yy > 0; yy--) {
+			memcpy(grid_raw_line(gd, dy + yy - 1),
+			    grid_raw_line(gd, py + yy - 1),
+			    sizeof *gd->linedata);
+		}
+	}
+}
+
+/* Release a reference to a packed block. */
+static void
+grid_release_block(struct grid_block *gb)
+{
+	u_int	i;
+
+	if (--gb->references != 0)
+		return;
+	for (i = 0; i < gb->nchars; i++)
+		utf8_remove_ref(gb->chars[i]);
+	free(gb->chars);
+	free(gb->data);
+	free(gb);
+}
+
+/* Pack one line into a buffer, returning the space used. */
+static size_t
+grid_pack_line(struct grid_line *gl, u_char *buf)
+{
+	struct grid_block_run	 run;
+	const u_char		*entry, *next;
+	u_char			*start = buf;
+	u_int			 px, n, i;
+	int			 repeat;
+
+	memcpy(buf, &gl->cellsize, sizeof gl->cellsize);
+	buf += sizeof gl->cellsize;
+	memcpy(buf, &gl->extdsize, sizeof gl->extdsize);
+	buf += sizeof gl->extdsize;
+
+	/*
+	 * Cells are stored as runs which share everything except the last
+	 * byte (the character for a normal cell). If that is the same for the
+	 * whole run, it is only stored once.
+	 */
+	for (px = 0; px < gl->cellsize; px += n) {
+		entry = (const u_char *)&gl->celldata[px];
+		repeat = 1;
+		for (n = 1; px + n < gl->cellsize; n++) {
+			if (n == GRID_BLOCK_RUN_MAX)
+				break;
+			next = (const u_char *)&gl->celldata[px + n];
+			if (memcmp(next, entry, sizeof run.entry) != 0)
+				break;
+			if (next[sizeof run.entry] != entry[sizeof run.entry])
+				repeat = 0;
+		}
+
+		memcpy(run.entry, entry, sizeof run.entry);
+		run.count = n;
+		if (repeat)
+			run.count |= GRID_BLOCK_RUN_REPEAT;
+		memcpy(buf, &run, sizeof run);
+		buf += sizeof run;
+
+		if (repeat)
+			*buf++ = entry[sizeof run.entry];
+		else {
+			for (i = 0; i < n; i++) {
+				entry = (const u_char *)&gl->celldata[px + i];
+				*buf++ = entry[sizeof run.entry];
+			}
+		}
+	}
+
+	if (gl->extdsize != 0) {
+		memcpy(buf, gl->extddata, gl->extdsize * sizeof *gl->extddata);
+		buf += gl->extdsize * sizeof *gl->extddata;
+	}
+	return (buf - start);
+}
+
+/* Unpack one line from a buffer. */
+static void
+grid_unpack_line(struct grid *gd, struct grid_line *gl, const u_char *buf)
+{
+	struct grid_block_run	 run;
+	u_char			*entry;
+	u_int			 px, n, i;
+
+	memcpy(&gl->cellsize, buf, sizeof gl->cellsize);
+	buf += sizeof gl->cellsize;
+	memcpy(&gl->extdsize, buf, sizeof gl->extdsize);
+	buf += sizeof gl->extdsize;
+
+	if (gl->cellsize != 0) {
+		gl->celldata = grid_arena_reallocarray(gd->arena, NULL,
+		    gl->cellsize, sizeof *gl->celldata);
+	} else
+		gl->celldata = NULL;
+	for (px = 0; px < gl->cellsize; px += n) {
+		memcpy(&run, buf, sizeof run);
+		buf += sizeof run;
+
+		n = run.count & GRID_BLOCK_RUN_MAX;
+		for (i = 0; i < n; i++) {
+			entry = (u_char *)&gl->celldata[px + i];
+			memcpy(entry, run.entry, sizeof run.entry);
+			entry[sizeof run.entry] = *buf;
+			if (~run.count & GRID_BLOCK_RUN_REPEAT)
+				buf++;
+		}
+		if (run.count & GRID_BLOCK_RUN_REPEAT)
+			buf++;
+	}
+
+	if (gl->extdsize != 0) {
+		gl->extddata = grid_arena_reallocarray(gd->arena, NULL,
+		    gl->extdsize, sizeof *gl->extddata);
+		memcpy(gl->extddata, buf, gl->extdsize * sizeof *gl->extddata);
+		for (i = 0; i < gl->extdsize; i++)
+			utf8_add_ref(gl->extddata[i].data);
+	} else
+		gl->extddata = NULL;
+	gl->flags &= ~GRID_LINE_PACKED;
+}
+
+/* Pack any lines in a range which are not already packed into a new block. */
+static void
+grid_pack_lines(struct grid *gd, u_int py, u_int ny)
+{
+	struct grid_block	*gb;
+	struct grid_line	*gl;
+	u_int			 yy, i;
+	utf8_char		 uc;
+	size_t			 size = 0;
+#ifdef HAVE_LZ4
+	u_char			*data;
+	int			 bound, stored;
+#endif
+
+	if (ny > GRID_BLOCK_LINES)
+		ny = GRID_BLOCK_LINES;
+
+	/* Work out the most space needed. */
+	for (yy = py; yy < py + ny; yy++) {
+		gl = grid_raw_line(gd, yy);
+		if (gl->flags & (GRID_LINE_PACKED|GRID_LINE_DEAD))
+			continue;
+		if (gl->cellsize == 0 && gl->extdsize == 0)
+			continue;
+		size += sizeof gl->cellsize + sizeof gl->extdsize;
+		size += gl->cellsize * (sizeof (struct grid_block_run) + 1);
+		size += gl->extdsize * sizeof *gl->extddata;
+	}
+	if (size == 0)
+		return;
+
+	gb = xcalloc(1, sizeof *gb);
+	gb->data = xmalloc(size);
+
+	for (yy = py; yy < py + ny; yy++) {
+		gl = grid_raw_line(gd, yy);
+		if (gl->flags & (GRID_LINE_PACKED|GRID_LINE_DEAD))
+			continue;
+		if (gl->cellsize == 0 && gl->extdsize == 0)
+			continue;
+
+		gb->offsets[gb->lines] = gb->size;
+		gb->size += grid_pack_line(gl, gb->data + gb->size);
+
+		/* The block takes over the line's UTF-8 references. */
+		for (i = 0; i < gl->extdsize; i++) {
+			uc = gl->extddata[i].data;
+			if (!utf8_in_table(uc))
+				continue;
+			gb->chars = xreallocarray(gb->chars, gb->nchars + 1,
+			    sizeof *gb->chars);
+			gb->chars[gb->nchars++] = uc;
+		}
+
+		grid_arena_free(gd->arena, gl->celldata);
+		grid_arena_free(gd->arena, gl->extddata);
+		gl->extddata = NULL;
+		gl->cellsize = 0;
+
+		gl->block = gb;
+		gl->blockline = gb->lines++;
+		gl->flags |= GRID_LINE_PACKED;
+		gb->references++;
+	}
+	gb->stored = gb->size;
+
+#ifdef HAVE_LZ4
+	bound = LZ4_compressBound(gb->size);
+	data = xmalloc(bound);
+	stored = LZ4_compress_default((const char *)gb->data, (char *)data,
+	    gb->size, bound);
+	if (stored > 0 && (size_t)stored < gb->size) {
+		free(gb->data);
+		gb->data = xrealloc(data, stored);
+		gb->stored = stored;
+		gb->compressed = 1;
+	} else
+		free(data);
+#endif
+	if (!gb->compressed)
+		gb->data = xrealloc(gb->data, gb->size);
+
+	log_debug("%s: packed %u lines at %u (%zu bytes, %zu stored)", __func__,
+	    gb->lines, py, gb->size, gb->stored);
+}
+
+/* Pack history lines which are old enough. */
+static void
+grid_pack_history(struct grid *gd)
+{
+	u_int	end;
+
+	if (gd->hsize < GRID_HOT_LINES)
+		return;
+	end = gd->hsize - GRID_HOT_LINES;
+	while (gd->hpacked < end && end - gd->hpacked >= GRID_BLOCK_LINES) {
+		grid_pack_lines(gd, gd->hpacked, GRID_BLOCK_LINES);
+		gd->hpacked += GRID_BLOCK_LINES;
+	}
+}
+
+/*
+ * Unpack a packed line. Any other lines from the same block near it are
+ * unpacked at the same time, so the block is only decompressed once. The lines
+ * in a block were packed from at most GRID_BLOCK_LINES adjacent lines.
+ */
+static void
+grid_unpack_block(struct grid *gd, u_int py)
+{
+	struct grid_line	*gl = grid_raw_line(gd, py);
+	struct grid_block	*gb = gl->block;
+	u_char			*data;
+	u_int			 first, yy, last;
+
+	if (py < GRID_BLOCK_LINES)
+		first = 0;
+	else
+		first = py - GRID_BLOCK_LINES + 1;
+	last = py + GRID_BLOCK_LINES;
+	if (last > gd->hsize + gd->sy)
+		last = gd->hsize + gd->sy;
+
+	gb->references++;
+#ifdef HAVE_LZ4
+	if (gb->compressed) {
+		data = xmalloc(gb->size);
+		if (LZ4_decompress_safe((const char *)gb->data, (char *)data,
+		    gb->stored, gb->size) != (int)gb->size)
+			fatalx("bad packed history");
+	} else
+#endif
+	data = gb->data;
+
+	for (yy = first; yy < last; yy++) {
+		gl = grid_raw_line(gd, yy);
+		if ((~gl->flags & GRID_LINE_PACKED) || gl->block != gb)
+			continue;
+		grid_unpack_line(gd, gl, data + gb->offsets[gl->blockline]);
+		grid_release_block(gb);
+
+		/* Make sure this line will be packed again. */
+		if (yy < gd->hpacked)
+			gd->hpacked = yy;
+	}
+	log_debug("%s: unpacked block of %u lines near %u", __func__,
+	    gb->lines, py);
+
+	if (data != gb->data)
+		free(data);
+	grid_release_block(gb);
+}
+
 /* Get line data. */
 struct grid_line *
 grid_get_line(struct grid *gd, u_int line)
 {
-	return (&gd->linedata[line]);
+	struct grid_line	*gl = grid_raw_line(gd, line);
+
+	if (gl->flags & GRID_LINE_PACKED)
+		grid_unpack_block(gd, line);
+	return (gl);
+}
+
+/* Get the number of cells allocated and the size of packed history. */
+void
+grid_get_size(struct grid *gd, u_int *cells, u_int *extended_cells,
+    size_t *packed)
+{
+	struct grid_line	*gl;
+	u_int			 yy;
+
+	*cells = *extended_cells = 0;
+	*packed = 0;
+	for (yy = 0; yy < gd->hsize + gd->sy; yy++) {
+		gl = grid_raw_line(gd, yy);
+		if (gl->flags & GRID_LINE_PACKED)
+			*packed += gl->block->stored / gl->block->lines;
+		else {
+			*cells += gl->cellsize;
+			*extended_cells += gl->extdsize;
+		}
+	}
 }
 
 /* Adjust number of lines. */
 void
 grid_adjust_lines(struct grid *gd, u_int lines)
 {
-	gd->linedata = xreallocarray(gd->linedata, lines, sizeof *gd->linedata);
+	grid_resize_lines(gd, lines);
 }
 
 /* Copy default into a cell. */
 static void
 grid_clear_cell(struct grid *gd, u_int px, u_int py, u_int bg)
 {
-	struct grid_line	*gl = &gd->linedata[py];
+	struct grid_line	*gl = grid_get_line(gd, py);
 	struct grid_cell_entry	*gce = &gl->celldata[px];
 	struct grid_extd_entry	*gee;
 
 	memcpy(gce, &grid_cleared_entry, sizeof *gce);
 	if (bg != 8) {
 		if (bg & COLOUR_FLAG_RGB) {
-			grid_get_extended_cell(gl, gce, gce->flags);
-			gee = grid_extended_cell(gl, gce, &grid_cleared_cell);
+			grid_get_extended_cell(gd, gl, gce, gce->flags);
+			gee = grid_extended_cell(gd, gl, gce,
+			    &grid_cleared_cell);
 			gee->bg = bg;
 		} else {
 			if (bg & COLOUR_FLAG_256)
@@ -251,10 +702,57 @@ grid_cells_equal(const struct grid_cell *gc1, const struct grid_cell *gc2)
 static void
 grid_free_line(struct grid *gd, u_int py)
 {
-	free(gd->linedata[py].celldata);
-	gd->linedata[py].celldata = NULL;
-	free(gd->linedata[py].extddata);
-	gd->linedata[py].extddata = NULL;
+	struct grid_line	*gl = grid_raw_line(gd, py);
+
+	if (gl->flags & GRID_LINE_PACKED) {
+		grid_release_block(gl->block);
+		gl->flags &= ~GRID_LINE_PACKED;
+		gl->extdsize = 0;
+	} else {
+		grid_release_extended(gl);
+		grid_arena_free(gd->arena, gl->celldata);
+	}
+	gl->celldata = NULL;
+	grid_arena_free(gd->arena, gl->extddata);
+	gl->extddata = NULL;
+}
+
+/*
+ * Move the cells of any unpacked lines into a new arena and release the old
+ * arena. This is done after a lot of lines have been freed, so the remaining
+ * lines are not left spread across many slabs.
+ */
+static void
+grid_renew_arena(struct grid *gd)
+{
+	struct grid_arena	*old = gd->arena;
+	struct grid_line	*gl;
+	void			*data;
+	u_int			 yy;
+
+	gd->arena = grid_arena_create();
+	for (yy = 0; yy < gd->hsize + gd->sy; yy++) {
+		gl = grid_raw_line(gd, yy);
+		if (gl->flags & GRID_LINE_PACKED)
+			continue;
+		if (gl->celldata != NULL) {
+			data = grid_arena_reallocarray(gd->arena, NULL,
+			    gl->cellsize, sizeof *gl->celldata);
+			memcpy(data, gl->celldata,
+			    gl->cellsize * sizeof *gl->celldata);
+			grid_arena_free(old, gl->celldata);
+			gl->celldata = data;
+		}
+		if (gl->extddata != NULL) {
+			data = grid_arena_reallocarray(gd->arena, NULL,
+			    gl->extdsize, sizeof *gl->extddata);
+			memcpy(data, gl->extddata,
+			    gl->extdsize * sizeof *gl->extddata);
+			grid_arena_free(old, gl->extddata);
+			gl->extddata = data;
+		}
+	}
+	grid_arena_destroy(old);
 }
 
 /* Free several lines. */
@@ -285,7 +783,11 @@ grid_create(u_int sx, u_int sy, u_int hlimit)
 	gd->hscrolled = 0;
 	gd->hsize = 0;
 	gd->hlimit = hlimit;
+	gd->hpacked = 0;
 
+	gd->linestart = 0;
+	gd->linesize = gd->sy;
+	gd->arena = grid_arena_create();
 	if (gd->sy != 0)
 		gd->linedata = xcalloc(gd->sy, sizeof *gd->linedata);
 	else
@@ -301,6 +803,7 @@ grid_destroy(struct grid *gd)
 	grid_free_lines(gd, 0, gd->hsize + gd->sy);
 
 	free(gd->linedata);
+	grid_arena_destroy(gd->arena);
 
 	free(gd);
 }
@@ -317,8 +820,8 @@ grid_compare(struct grid *ga, struct grid *gb)
 		return (1);
 
 	for (yy = 0; yy < ga->sy; yy++) {
-		gla = &ga->linedata[yy];
-		glb = &gb->linedata[yy];
+		gla = grid_get_line(ga, yy);
+		glb = grid_get_line(gb, yy);
 		if (gla->cellsize != glb->cellsize)
 			return (1);
 		for (xx = 0; xx < gla->cellsize; xx++) {
@@ -337,13 +840,14 @@ static void
 grid_trim_history(struct grid *gd, u_int ny)
 {
 	grid_free_lines(gd, 0, ny);
-	memmove(&gd->linedata[0], &gd->linedata[ny],
-	    (gd->hsize + gd->sy - ny) * (sizeof *gd->linedata));
+	if (ny == 0)
+		return;
+	gd->linestart = (gd->linestart + ny) % gd->linesize;
 }
 
 /*
  * Collect lines from the history if at the limit. Free the top (oldest) 10%
- * and shift up.
+ * and move the start of the ring past them.
  */
 void
 grid_collect_history(struct grid *gd)
@@ -359,15 +863,16 @@ grid_collect_history(struct grid *gd)
 	if (ny > gd->hsize)
 		ny = gd->hsize;
 
-	/*
-	 * Free the lines from 0 to ny then move the remaining lines over
-	 * them.
-	 */
+	/* Free the lines from 0 to ny and start after them. */
 	grid_trim_history(gd, ny);
 
 	gd->hsize -= ny;
 	if (gd->hscrolled > gd->hsize)
 		gd->hscrolled = gd->hsize;
+	if (gd->hpacked > ny)
+		gd->hpacked -= ny;
+	else
+		gd->hpacked = 0;
 }
 
 /* Remove lines from the bottom of the history. */
@@ -381,6 +886,8 @@ grid_remove_history(struct grid *gd, u_int ny)
 	for (yy = 0; yy < ny; yy++)
 		grid_free_line(gd, gd->hsize + gd->sy - 1 - yy);
 	gd->hsize -= ny;
+	if (gd->hpacked > gd->hsize)
+		gd->hpacked = gd->hsize;
 }
 
 /*
@@ -393,13 +900,14 @@ grid_scroll_history(struct grid *gd, u_int bg)
 	u_int	yy;
 
 	yy = gd->hsize + gd->sy;
-	gd->linedata = xreallocarray(gd->linedata, yy + 1,
-	    sizeof *gd->linedata);
+	grid_reserve_line(gd);
 	grid_empty_line(gd, yy, bg);
 
 	gd->hscrolled++;
-	grid_compact_line(&gd->linedata[gd->hsize]);
+	grid_compact_line(gd, grid_get_line(gd, gd->hsize));
 	gd->hsize++;
+
+	grid_pack_history(gd);
 }
 
 /* Clear the history. */
@@ -410,42 +918,39 @@ grid_clear_history(struct grid *gd)
 
 	gd->hscrolled = 0;
 	gd->hsize = 0;
+	gd->hpacked = 0;
 
-	gd->linedata = xreallocarray(gd->linedata, gd->sy,
-	    sizeof *gd->linedata);
+	grid_resize_lines(gd, gd->sy);
+	grid_renew_arena(gd);
 }
 
 /* Scroll a region up, moving the top line into the history. */
 void
 grid_scroll_history_region(struct grid *gd, u_int upper, u_int lower, u_int bg)
 {
-	struct grid_line	*gl_history, *gl_upper;
-	u_int			 yy;
-
 	/* Create a space for a new line. */
-	yy = gd->hsize + gd->sy;
-	gd->linedata = xreallocarray(gd->linedata, yy + 1,
-	    sizeof *gd->linedata);
+	grid_reserve_line(gd);
 
 	/* Move the entire screen down to free a space for this line. */
-	gl_history = &gd->linedata[gd->hsize];
-	memmove(gl_history + 1, gl_history, gd->sy * sizeof *gl_history);
+	grid_move_raw_lines(gd, gd->hsize + 1, gd->hsize, gd->sy);
 
 	/* Adjust the region and find its start and end. */
 	upper++;
-	gl_upper = &gd->linedata[upper];
 	lower++;
 
 	/* Move the line into the history. */
-	memcpy(gl_history, gl_upper, sizeof *gl_history);
+	memcpy(grid_raw_line(gd, gd->hsize), grid_raw_line(gd, upper),
+	    sizeof *gd->linedata);
 
 	/* Then move the region up and clear the bottom line. */
-	memmove(gl_upper, gl_upper + 1, (lower - upper) * sizeof *gl_upper);
+	grid_move_raw_lines(gd, upper, upper + 1, lower - upper);
 	grid_empty_line(gd, lower, bg);
 
 	/* Move the history offset down over the line. */
 	gd->hscrolled++;
 	gd->hsize++;
+
+	grid_pack_history(gd);
 }
 
 /* Expand line to fit to cell. */
@@ -455,7 +960,7 @@ grid_expand_line(struct grid *gd, u_int py, u_int sx, u_int bg)
 	struct grid_line	*gl;
 	u_int			 xx;
 
-	gl = &gd->linedata[py];
+	gl = grid_get_line(gd, py);
 	if (sx <= gl->cellsize)
 		return;
 
@@ -466,7 +971,8 @@ grid_expand_line(struct grid *gd, u_int py, u_int sx, u_int bg)
 	else
 		sx = gd->sx;
 
-	gl->celldata = xreallocarray(gl->celldata, sx, sizeof *gl->celldata);
+	gl->celldata = grid_arena_reallocarray(gd->arena, gl->celldata, sx,
+	    sizeof *gl->celldata);
 	for (xx = gl->cellsize; xx < sx; xx++)
 		grid_clear_cell(gd, xx, py, bg);
 	gl->cellsize = sx;
@@ -476,7 +982,7 @@ grid_expand_line(struct grid *gd, u_int py, u_int sx, u_int bg)
 void
 grid_empty_line(struct grid *gd, u_int py, u_int bg)
 {
-	memset(&gd->linedata[py], 0, sizeof gd->linedata[py]);
+	memset(grid_raw_line(gd, py), 0, sizeof *gd->linedata);
 	if (!COLOUR_DEFAULT(bg))
 		grid_expand_line(gd, py, gd->sx, bg);
 }
@@ -487,7 +993,7 @@ grid_peek_line(struct grid *gd, u_int py)
 {
 	if (grid_check_y(gd, __func__, py) != 0)
 		return (NULL);
-	return (&gd->linedata[py]);
+	return (grid_get_line(gd, py));
 }
 
 /* Get cell from line. */
@@ -528,11 +1034,17 @@ grid_get_cell1(struct grid_line *gl, u_int px, struct grid_cell *gc)
 void
 grid_get_cell(struct grid *gd, u_int px, u_int py, struct grid_cell *gc)
 {
-	if (grid_check_y(gd, __func__, py) != 0 ||
-	    px >= gd->linedata[py].cellsize)
+	struct grid_line	*gl;
+
+	if (grid_check_y(gd, __func__, py) != 0) {
+		memcpy(gc, &grid_default_cell, sizeof *gc);
+		return;
+	}
+	gl = grid_get_line(gd, py);
+	if (px >= gl->cellsize)
 		memcpy(gc, &grid_default_cell, sizeof *gc);
 	else
-		grid_get_cell1(&gd->linedata[py], px, gc);
+		grid_get_cell1(gl, px, gc);
 }
 
 /* Set cell at position. */
@@ -547,13 +1059,13 @@ grid_set_cell(struct grid *gd, u_int px, u_int py, const struct grid_cell *gc)
 
 	grid_expand_line(gd, py, px + 1, 8);
 
-	gl = &gd->linedata[py];
+	gl = grid_raw_line(gd, py);
 	if (px + 1 > gl->cellused)
 		gl->cellused = px + 1;
 
 	gce = &gl->celldata[px];
 	if (grid_need_extended_cell(gce, gc))
-		grid_extended_cell(gl, gce, gc);
+		grid_extended_cell(gd, gl, gce, gc);
 	else
 		grid_store_cell(gce, gc, gc->data.data[0]);
 }
@@ -580,14 +1092,15 @@ grid_set_cells(struct grid *gd, u_int px, u_int py, const struct grid_cell *gc,
 
 	grid_expand_line(gd, py, px + slen, 8);
 
-	gl = &gd->linedata[py];
+	gl = grid_raw_line(gd, py);
 	if (px + slen > gl->cellused)
 		gl->cellused = px + slen;
 
 	for (i = 0; i < slen; i++) {
 		gce = &gl->celldata[px + i];
 		if (grid_need_extended_cell(gce, gc)) {
-			gee = grid_extended_cell(gl, gce, gc);
+			gee = grid_extended_cell(gd, gl, gce, gc);
+			utf8_remove_ref(gee->data);
 			gee->data = utf8_build_one(s[i]);
 		} else
 			grid_store_cell(gce, gc, s[i]);
@@ -615,7 +1128,7 @@ grid_clear(struct grid *gd, u_int px, u_int py, u_int nx, u_int ny, u_int bg)
 		return;
 
 	for (yy = py; yy < py + ny; yy++) {
-		gl = &gd->linedata[yy];
+		gl = grid_get_line(gd, yy);
 
 		sx = gd->sx;
 		if (sx > gl->cellsize)
@@ -653,7 +1166,7 @@ grid_clear_lines(struct grid *gd, u_int py, u_int ny, u_int bg)
 		grid_empty_line(gd, yy, bg);
 	}
 	if (py != 0)
-		gd->linedata[py - 1].flags &= ~GRID_LINE_WRAPPED;
+		grid_raw_line(gd, py - 1)->flags &= ~GRID_LINE_WRAPPED;
 }
 
 /* Move a group of lines. */
@@ -681,10 +1194,9 @@ grid_move_lines(struct grid *gd, u_int dy, u_int py, u_int ny, u_int bg)
 		grid_free_line(gd, yy);
 	}
 	if (dy != 0)
-		gd->linedata[dy - 1].flags &= ~GRID_LINE_WRAPPED;
+		grid_raw_line(gd, dy - 1)->flags &= ~GRID_LINE_WRAPPED;
 
-	memmove(&gd->linedata[dy], &gd->linedata[py],
-	    ny * (sizeof *gd->linedata));
+	grid_move_raw_lines(gd, dy, py, ny);
 
 	/*
 	 * Wipe any lines that have been moved (without freeing them - they are
@@ -695,7 +1207,7 @@ grid_move_lines(struct grid *gd, u_int dy, u_int py, u_int ny, u_int bg)
 			grid_empty_line(gd, yy, bg);
 	}
 	if (py != 0 && (py < dy || py >= dy + ny))
-		gd->linedata[py - 1].flags &= ~GRID_LINE_WRAPPED;
+		grid_raw_line(gd, py - 1)->flags &= ~GRID_LINE_WRAPPED;
 }
 
 
@@ -712,7 +1224,7 @@ grid_move_cells(struct grid *gd, u_int dx, u_int px, u_int py, u_int nx,
 
 	if (grid_check_y(gd, __func__, py) != 0)
 		return;
-	gl = &gd->linedata[py];
+	gl = grid_get_line(gd, py);
 
 	grid_expand_line(gd, py, px + nx, 8);
 	grid_expand_line(gd, py, dx + nx, 8);
@@ -1026,7 +1538,7 @@ grid_duplicate_lines(struct grid *dst, u_int dy, struct grid *src, u_int sy,
     u_int ny)
 {
 	struct grid_line	*dstl, *srcl;
-	u_int			 yy;
+	u_int			 yy, i;
 
 	if (dy + ny > dst->hsize + dst->sy)
 		ny = dst->hsize + dst->sy - dy;
@@ -1035,13 +1547,19 @@ grid_duplicate_lines(struct grid *dst, u_int dy, struct grid *src, u_int sy,
 	grid_free_lines(dst, dy, ny);
 
 	for (yy = 0; yy < ny; yy++) {
-		srcl = &src->linedata[sy];
-		dstl = &dst->linedata[dy];
+		srcl = grid_raw_line(src, sy);
+		dstl = grid_raw_line(dst, dy);
 
 		memcpy(dstl, srcl, sizeof *dstl);
+		if (srcl->flags & GRID_LINE_PACKED) {
+			srcl->block->references++;
+			sy++;
+			dy++;
+			continue;
+		}
 		if (srcl->cellsize != 0) {
-			dstl->celldata = xreallocarray(NULL,
-			    srcl->cellsize, sizeof *dstl->celldata);
+			dstl->celldata = grid_arena_reallocarray(dst->arena,
+			    NULL, srcl->cellsize, sizeof *dstl->celldata);
 			memcpy(dstl->celldata, srcl->celldata,
 			    srcl->cellsize * sizeof *dstl->celldata);
 		} else
@@ -1049,10 +1567,12 @@ grid_duplicate_lines(struct grid *dst, u_int dy, struct grid *src, u_int sy,
 
 		if (srcl->extdsize != 0) {
 			dstl->extdsize = srcl->extdsize;
-			dstl->extddata = xreallocarray(NULL, dstl->extdsize,
-			    sizeof *dstl->extddata);
+			dstl->extddata = grid_arena_reallocarray(dst->arena,
+			    NULL, dstl->extdsize, sizeof *dstl->extddata);
 			memcpy(dstl->extddata, srcl->extddata, dstl->extdsize *
 			    sizeof *dstl->extddata);
+			for (i = 0; i < dstl->extdsize; i++)
+				utf8_add_ref(dstl->extddata[i].data);
 		}
 
 		sy++;
@@ -1075,8 +1595,8 @@ grid_reflow_add(struct grid *gd, u_int n)
 	struct grid_line	*gl;
 	u_int			 sy = gd->sy + n;
 
-	gd->linedata = xreallocarray(gd->linedata, sy, sizeof *gd->linedata);
-	gl = &gd->linedata[gd->sy];
+	grid_resize_lines(gd, sy);
+	gl = grid_raw_line(gd, gd->sy);
 	memset(gl, 0, n * (sizeof *gl));
 	gd->sy = sy;
 	return (gl);
@@ -1110,10 +1630,10 @@ grid_reflow_join(struct grid *target, struct grid *gd, u_int sx, u_int yy,
 	 */
 	if (!already) {
 		to = target->sy;
-		gl = grid_reflow_move(target, &gd->linedata[yy]);
+		gl = grid_reflow_move(target, grid_raw_line(gd, yy));
 	} else {
 		to = target->sy - 1;
-		gl = &target->linedata[to];
+		gl = grid_raw_line(target, to);
 	}
 	at = gl->cellused;
 
@@ -1131,9 +1651,9 @@ grid_reflow_join(struct grid *target, struct grid *gd, u_int sx, u_int yy,
 		line = yy + 1 + lines;
 
 		/* If the next line is empty, skip it. */
-		if (~gd->linedata[line].flags & GRID_LINE_WRAPPED)
+		if (~grid_raw_line(gd, line)->flags & GRID_LINE_WRAPPED)
 			wrapped = 0;
-		if (gd->linedata[line].cellused == 0) {
+		if (grid_raw_line(gd, line)->cellused == 0) {
 			if (!wrapped)
 				break;
 			lines++;
@@ -1145,7 +1665,7 @@ grid_reflow_join(struct grid *target, struct grid *gd, u_int sx, u_int yy,
 		 * separately because we need to leave "from" set to the last
 		 * line if this line is full.
 		 */
-		grid_get_cell1(&gd->linedata[line], 0, &gc);
+		grid_get_cell1(grid_raw_line(gd, line), 0, &gc);
 		if (width + gc.data.width > sx)
 			break;
 		width += gc.data.width;
@@ -1153,7 +1673,7 @@ grid_reflow_join(struct grid *target, struct grid *gd, u_int sx, u_int yy,
 		at++;
 
 		/* Join as much more as possible onto the current line. */
-		from = &gd->linedata[line];
+		from = grid_raw_line(gd, line);
 		for (want = 1; want < from->cellused; want++) {
 			grid_get_cell1(from, want, &gc);
 			if (width + gc.data.width > sx)
@@ -1190,9 +1710,10 @@ grid_reflow_join(struct grid *target, struct grid *gd, u_int sx, u_int yy,
 
 	/* Remove the lines that were completely consumed. */
 	for (i = yy + 1; i < yy + 1 + lines; i++) {
-		free(gd->linedata[i].celldata);
-		free(gd->linedata[i].extddata);
-		grid_reflow_dead(&gd->linedata[i]);
+		grid_release_extended(grid_raw_line(gd, i));
+		grid_arena_free(gd->arena, grid_raw_line(gd, i)->celldata);
+		grid_arena_free(gd->arena, grid_raw_line(gd, i)->extddata);
+		grid_reflow_dead(grid_raw_line(gd, i));
 	}
 
 	/* Adjust scroll position. */
@@ -1207,7 +1728,7 @@ static void
 grid_reflow_split(struct grid *target, struct grid *gd, u_int sx, u_int yy,
     u_int at)
 {
-	struct grid_line	*gl = &gd->linedata[yy], *first;
+	struct grid_line	*gl = grid_raw_line(gd, yy), *first;
 	struct grid_cell	 gc;
 	u_int			 line, lines, width, i, xx;
 	u_int			 used = gl->cellused;
@@ -1239,7 +1760,7 @@ grid_reflow_split(struct grid *target, struct grid *gd, u_int sx, u_int yy,
 	for (i = at; i < used; i++) {
 		grid_get_cell1(gl, i, &gc);
 		if (width + gc.data.width > sx) {
-			target->linedata[line].flags |= GRID_LINE_WRAPPED;
+			grid_raw_line(target, line)->flags |= GRID_LINE_WRAPPED;
 
 			line++;
 			width = 0;
@@ -1250,7 +1771,7 @@ grid_reflow_split(struct grid *target, struct grid *gd, u_int sx, u_int yy,
 		xx++;
 	}
 	if (flags & GRID_LINE_WRAPPED)
-		target->linedata[line].flags |= GRID_LINE_WRAPPED;
+		grid_raw_line(target, line)->flags |= GRID_LINE_WRAPPED;
 
 	/* Move the remainder of the original line. */
 	gl->cellsize = gl->cellused = at;
@@ -1279,17 +1800,23 @@ grid_reflow(struct grid *gd, u_int sx)
 	struct grid_cell	 gc;
 	u_int			 yy, width, i, at, first;
 
+	/* Every line may need to be changed so unpack them all. */
+	for (yy = 0; yy < gd->hsize + gd->sy; yy++)
+		grid_get_line(gd, yy);
+
 	/*
 	 * Create a destination grid. This is just used as a container for the
 	 * line data and may not be fully valid.
 	 */
 	target = grid_create(gd->sx, 0, 0);
+	grid_arena_destroy(target->arena);
+	target->arena = gd->arena;
 
 	/*
 	 * Loop over each source line.
 	 */
 	for (yy = 0; yy < gd->hsize + gd->sy; yy++) {
-		gl = &gd->linedata[yy];
+		gl = grid_raw_line(gd, yy);
 		if (gl->flags & GRID_LINE_DEAD)
 			continue;
 
@@ -1355,7 +1882,13 @@ grid_reflow(struct grid *gd, u_int sx)
 		gd->hscrolled = gd->hsize;
 	free(gd->linedata);
 	gd->linedata = target->linedata;
+	gd->linestart = target->linestart;
+	gd->linesize = target->linesize;
 	free(target);
+
+	gd->hpacked = 0;
+	grid_pack_history(gd);
+	grid_renew_arena(gd);
 }
 
 /* Convert to position based on wrapped lines. */
@@ -1365,14 +1898,14 @@ grid_wrap_position(struct grid *gd, u_int px, u_int py, u_int *wx, u_int *wy)
 	u_int	ax = 0, ay = 0, yy;
 
 	for (yy = 0; yy < py; yy++) {
-		if (gd->linedata[yy].flags & GRID_LINE_WRAPPED)
-			ax += gd->linedata[yy].cellused;
+		if (grid_raw_line(gd, yy)->flags & GRID_LINE_WRAPPED)
+			ax += grid_raw_line(gd, yy)->cellused;
 		else {
 			ax = 0;
 			ay++;
 		}
 	}
-	if (px >= gd->linedata[yy].cellused)
+	if (px >= grid_raw_line(gd, yy)->cellused)
 		ax = UINT_MAX;
 	else
 		ax += px;
@@ -1389,7 +1922,7 @@ grid_unwrap_position(struct grid *gd, u_int *px, u_int *py, u_int wx, u_int wy)
 	for (yy = 0; yy < gd->hsize + gd->sy - 1; yy++) {
 		if (ay == wy)
 			break;
-		if (~gd->linedata[yy].flags & GRID_LINE_WRAPPED)
+		if (~grid_raw_line(gd, yy)->flags & GRID_LINE_WRAPPED)
 			ay++;
 	}
 
@@ -1398,14 +1931,14 @@ grid_unwrap_position(struct grid *gd, u_int *px, u_int *py, u_int wx, u_int wy)
 	 * until we find the end or the line now containing wx.
 	 */
 	if (wx == UINT_MAX) {
-		while (gd->linedata[yy].flags & GRID_LINE_WRAPPED)
+		while (grid_raw_line(gd, yy)->flags & GRID_LINE_WRAPPED)
 			yy++;
-		wx = gd->linedata[yy].cellused;
+		wx = grid_raw_line(gd, yy)->cellused;
 	} else {
-		while (gd->linedata[yy].flags & GRID_LINE_WRAPPED) {
-			if (wx < gd->linedata[yy].cellused)
+		while (grid_raw_line(gd, yy)->flags & GRID_LINE_WRAPPED) {
+			if (wx < grid_raw_line(gd, yy)->cellused)
 				break;
-			wx -= gd->linedata[yy].cellused;
+			wx -= grid_raw_line(gd, yy)->cellused;
 			yy++;
 		}
 	}
@@ -152,6 +152,7 @@ static void	input_exit_rename(struct input_ctx *);
 
 /* Input state handlers. */
 static int	input_print(struct input_ctx *);
+static void	input_print_run(struct input_ctx *, const u_char *, size_t);
 static int	input_intermediate(struct input_ctx *);
 static int	input_parameter(struct input_ctx *);
 static int	input_input(struct input_ctx *);
@@ -851,6 +852,7 @@ input_reset(struct input_ctx *ictx, int clear)
 			screen_write_start(sctx, &wp->base);
 		screen_write_reset(sctx);
 		screen_write_stop(sctx);
+		format_free_memos(&wp->memos);
 	}
 
 	input_clear(ictx);
@@ -879,6 +881,32 @@ input_set_state(struct input_ctx *ictx, const struct input_transition *itr)
 		ictx->state->enter(ictx);
 }
 
+/*
+ * Return the length of the run of printable ASCII (0x20 to 0x7e) at the start
+ * of a buffer. This is checked a word at a time: after masking off the top
+ * bit, adding 0x01 to each byte sets the top bit for 0x7f and adding 0x60 sets
+ * it for anything 0x20 or above, and neither can carry into the next byte.
+ */
+static size_t
+input_printable(const u_char *buf, size_t len)
+{
+	const uint64_t	 ones = 0x0101010101010101ULL;
+	const uint64_t	 high = 0x8080808080808080ULL;
+	uint64_t	 w, x;
+	size_t		 off = 0;
+
+	while (len - off >= sizeof w) {
+		memcpy(&w, buf + off, sizeof w);
+		x = w & ~high;
+		if ((w | (x + ones) | ~(x + (ones * 0x60))) & high)
+			break;
+		off += sizeof w;
+	}
+	while (off < len && buf[off] >= 0x20 && buf[off] <= 0x7e)
+		off++;
+	return (off);
+}
+
 /* Parse data. */
 static void
 input_parse(struct input_ctx *ictx, u_char *buf, size_t len)
@@ -886,10 +914,24 @@ input_parse(struct input_ctx *ictx, u_char *buf, size_t len)
 	struct screen_write_ctx		*sctx = &ictx->ctx;
 	const struct input_state	*state = NULL;
 	const struct input_transition	*itr = NULL;
-	size_t				 off = 0;
+	size_t				 off = 0, n;
 
 	/* Parse the input. */
 	while (off < len) {
+		/*
+		 * Most input is printable text in the ground state, so handle
+		 * the whole run at once rather than going through the
+		 * transition table for each character.
+		 */
+		if (ictx->state == &input_state_ground) {
+			n = input_printable(buf + off, len - off);
+			if (n != 0) {
+				input_print_run(ictx, buf + off, n);
+				off += n;
+				continue;
+			}
+		}
+
 		ictx->ch = buf[off++];
 
 		/* Find the transition. */
@@ -962,6 +1004,8 @@ input_parse_buffer(struct window_pane *wp, u_char *buf, size_t len)
 
 	window_update_activity(wp->window);
 	wp->flags |= PANE_CHANGED;
+	wp->flags &= ~(PANE_NAMESAMPLED|PANE_CWDSAMPLED);
+	format_free_memos(&wp->memos);
 
 	/* NULL wp if there is a mode set as don't want to update the tty. */
 	if (TAILQ_EMPTY(&wp->modes))
@@ -1115,25 +1159,34 @@ input_ground(struct input_ctx *ictx)
 /* Output this character to the screen. */
 static int
 input_print(struct input_ctx *ictx)
+{
+	u_char	ch = ictx->ch;
+
+	input_print_run(ictx, &ch, 1);
+	return (0);
+}
+
+/* Output a run of printable characters to the screen. */
+static void
+input_print_run(struct input_ctx *ictx, const u_char *buf, size_t len)
 {
 	struct screen_write_ctx	*sctx = &ictx->ctx;
+	struct grid_cell	*gc = &ictx->cell.cell;
 	int			 set;
 
 	ictx->utf8started = 0; /* can't be valid UTF-8 */
 
 	set = ictx->cell.set == 0 ? ictx->cell.g0set : ictx->cell.g1set;
 	if (set == 1)
-		ictx->cell.cell.attr |= GRID_ATTR_CHARSET;
+		gc->attr |= GRID_ATTR_CHARSET;
 	else
-		ictx->cell.cell.attr &= ~GRID_ATTR_CHARSET;
+		gc->attr &= ~GRID_ATTR_CHARSET;
 
-	utf8_set(&ictx->cell.cell.data, ictx->ch);
-	screen_write_collect_add(sctx, &ictx->cell.cell);
-	ictx->last = ictx->ch;
+	utf8_set(&gc->data, buf[len - 1]);
+	screen_write_collect_add_ascii(sctx, gc, buf, len);
+	ictx->ch = ictx->last = buf[len - 1];
 
-	ictx->cell.cell.attr &= ~GRID_ATTR_CHARSET;
-
-	return (0);
+	gc->attr &= ~GRID_ATTR_CHARSET;
 }
 
 /* Collect intermediate string. */
@@ -29,6 +29,12 @@
 static FILE	*log_file;
 static int	 log_level;
 
+/*
+ * Set when the log file is open. log_debug checks this before evaluating its
+ * arguments so it costs nothing when logging is off.
+ */
+int		 log_enabled;
+
 static void	 log_event_cb(int, const char *);
 static void	 log_vwrite(const char *, va_list);
 
@@ -71,6 +77,7 @@ log_open(const char *name)
 
 	setvbuf(log_file, NULL, _IOLBF, 0);
 	event_set_log_callback(log_event_cb);
+	log_enabled = 1;
 }
 
 /* Toggle logging. */
@@ -95,6 +102,7 @@ log_close(void)
 	if (log_file != NULL)
 		fclose(log_file);
 	log_file = NULL;
+	log_enabled = 0;
 
 	event_set_log_callback(NULL);
 }
@@ -124,9 +132,9 @@ log_vwrite(const char *msg, va_list ap)
 	free(fmt);
 }
 
-/* Log a debug message. */
+/* Log a debug message. Normally called through log_debug. */
 void
-log_debug(const char *msg, ...)
+log_write(const char *msg, ...)
 {
 	va_list	ap;
 
@@ -173,6 +173,15 @@ static const char *options_table_status_format_default[] = {
 /* Top-level options. */
 const struct options_table_entry options_table[] = {
 	/* Server options. */
+	{ .name = "ambiguous-width",
+	  .type = OPTIONS_TABLE_NUMBER,
+	  .scope = OPTIONS_TABLE_SERVER,
+	  .minimum = 1,
+	  .maximum = 2,
+	  .default_num = 1,
+	  .text = "The width of East Asian ambiguous characters."
+	},
+
 	{ .name = "backspace",
 	  .type = OPTIONS_TABLE_KEY,
 	  .scope = OPTIONS_TABLE_SERVER,
@@ -313,6 +322,14 @@ const struct options_table_entry options_table[] = {
 		  "automatically detected."
 	},
 
+	{ .name = "terminal-shadow",
+	  .type = OPTIONS_TABLE_FLAG,
+	  .scope = OPTIONS_TABLE_SERVER,
+	  .default_num = 0,
+	  .text = "Whether to keep a copy of the terminal contents to avoid "
+		  "redrawing cells which have not changed."
+	},
+
 	{ .name = "user-keys",
 	  .type = OPTIONS_TABLE_STRING,
 	  .scope = OPTIONS_TABLE_SERVER,
@@ -1066,6 +1066,12 @@ options_push_changes(const char *name)
 	struct window		*w;
 	struct window_pane	*wp;
 
+	format_invalidate_memos();
+
+	if (strcmp(name, "ambiguous-width") == 0) {
+		utf8_set_ambiguous_width(options_get_number(global_options,
+		    name));
+	}
 	if (strcmp(name, "automatic-rename") == 0) {
 		RB_FOREACH(w, windows, &windows) {
 			if (w->active == NULL)
@@ -21,8 +21,9 @@
 #include <sys/param.h>
 
 #include <event.h>
-#include <stdio.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "tmux.h"
@@ -30,34 +31,40 @@
 char *
 osdep_get_name(int fd, __unused char *tty)
 {
-	FILE	*f;
-	char	*path, *buf;
-	size_t	 len;
-	int	 ch;
+	char	 path[64], data[256], *buf, *end;
+	size_t	 len, size;
+	ssize_t	 n;
 	pid_t	 pgrp;
+	int	 f;
 
 	if ((pgrp = tcgetpgrp(fd)) == -1)
 		return (NULL);
 
-	xasprintf(&path, "/proc/%lld/cmdline", (long long) pgrp);
-	if ((f = fopen(path, "r")) == NULL) {
-		free(path);
+	xsnprintf(path, sizeof path, "/proc/%lld/cmdline", (long long) pgrp);
+	if ((f = open(path, O_RDONLY)) == -1)
 		return (NULL);
-	}
-	free(path);
 
+	/* Only the first argument is needed, read until its terminator. */
 	len = 0;
 	buf = NULL;
-	while ((ch = fgetc(f)) != EOF) {
-		if (ch == '\0')
+	while ((n = read(f, data, sizeof data)) > 0) {
+		end = memchr(data, '\0', n);
+		if (end != NULL)
+			size = end - data;
+		else
+			size = n;
+		if (size != 0) {
+			buf = xrealloc(buf, len + size + 1);
+			memcpy(buf + len, data, size);
+			len += size;
+		}
+		if (end != NULL)
 			break;
-		buf = xrealloc(buf, len + 2);
-		buf[len++] = ch;
 	}
 	if (buf != NULL)
 		buf[len] = '\0';
 
-	fclose(f);
+	close(f);
 	return (buf);
 }
 
@@ -65,21 +72,19 @@ char *
 osdep_get_cwd(int fd)
 {
 	static char	 target[MAXPATHLEN + 1];
-	char		*path;
+	char		 path[64];
 	pid_t		 pgrp, sid;
 	ssize_t		 n;
 
 	if ((pgrp = tcgetpgrp(fd)) == -1)
 		return (NULL);
 
-	xasprintf(&path, "/proc/%lld/cwd", (long long) pgrp);
+	xsnprintf(path, sizeof path, "/proc/%lld/cwd", (long long) pgrp);
 	n = readlink(path, target, MAXPATHLEN);
-	free(path);
 
 	if (n == -1 && ioctl(fd, TIOCGSID, &sid) != -1) {
-		xasprintf(&path, "/proc/%lld/cwd", (long long) sid);
+		xsnprintf(path, sizeof path, "/proc/%lld/cwd", (long long) sid);
 		n = readlink(path, target, MAXPATHLEN);
-		free(path);
 	}
 
 	if (n > 0) {
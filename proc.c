@@ -188,17 +188,11 @@ proc_start(const char *name)
 	log_debug("%s started (%ld): version %s, socket %s, protocol %d", name,
 	    (long)getpid(), getversion(), socket_path, PROTOCOL_VERSION);
 	log_debug("on %s %s %s", u.sysname, u.release, u.version);
-	log_debug("using libevent %s (%s)"
-#ifdef HAVE_UTF8PROC
-	    "; utf8proc %s"
-#endif
+	log_debug("using libevent %s (%s); unicode %s"
 #ifdef NCURSES_VERSION
 	    "; ncurses " NCURSES_VERSION
 #endif
-	    , event_get_version(), event_get_method()
-#ifdef HAVE_UTF8PROC
-	    , utf8proc_version ()
-#endif
+	    , event_get_version(), event_get_method(), utf8_width_version
 	);
 
 	tp = xcalloc(1, sizeof *tp);
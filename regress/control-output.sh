@@ -0,0 +1,75 @@
+#!/bin/sh
+
+# Flood a pane with output while a control client is attached and report how
+# fast the %output lines are written. Also check the escaping of some bytes.
+# Set CONTROL_MB to change the amount of output (default 16).
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+$TMUX kill-server 2>/dev/null
+
+[ -z "$CONTROL_MB" ] && CONTROL_MB=16
+
+TMP=$(mktemp)
+OUT=$(mktemp)
+trap "rm -f $TMP $OUT" 0 1 15
+
+awk -v n=$((CONTROL_MB * 1024 * 1024 / 64)) 'BEGIN {
+	l = "the quick brown fox jumps over the lazy dog\t0123456789 \\ \303\251"
+	for (i = 0; i < n; i++)
+		print l
+	print "END OF FLOOD"
+}' >$TMP
+
+# Decode the last few %output lines of base64 output.
+decode()
+{
+	tail -n20 $OUT|grep '^%output %0 '|cut -d' ' -f3|while read l; do
+		printf %s "$l"|base64 -d 2>/dev/null
+	done
+}
+
+# Flood the pane with the control client flags given and wait for the end.
+flood()
+{
+	$TMUX kill-server 2>/dev/null
+	$TMUX -f/dev/null new -d -x80 -y24 "$TMUX wait start; cat $TMP; cat" ||
+		exit 1
+	sleep 1
+	(
+		echo "refresh-client -f '$1'"
+		$TMUX wait -S start
+		START=$(date +%s%N)
+		if [ -z "$1" ]; then
+			while ! tail -c200 $OUT|grep -q 'END OF FLOOD'; do
+				sleep 0.01
+			done
+		else
+			while ! decode|grep -q 'END OF FLOOD'; do
+				sleep 0.01
+			done
+		fi
+		END=$(date +%s%N)
+		awk -v s=$START -v e=$END -v mb=$CONTROL_MB -v f="$1" 'BEGIN {
+			t = (e - s) / 1000000000
+			if (f != "")
+				f = " (" f ")"
+			if (t > 0)
+				printf "control-output%s: %u MB in %.3f seconds (%.1f MB/s)\n", f, mb, t, mb / t
+		}' >&2
+	) | $TMUX -C a >$OUT
+	$TMUX kill-server 2>/dev/null
+}
+
+flood ""
+L=$(printf 'the quick brown fox jumps over the lazy dog\\0110123456789 \\134 \303\251\\015\\012')
+grep '^%output %0 ' $OUT|grep -qF "$L" || exit 1
+
+flood base64-output
+L=$(printf 'the quick brown fox jumps over the lazy dog\t0123456789 \\ \303\251\r')
+decode|grep -qF "$L" || exit 1
+
+exit 0
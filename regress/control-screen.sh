@@ -0,0 +1,42 @@
+#!/bin/sh
+
+# A control client with a pane in screen mode should get the changed lines of
+# the pane rather than its output, with many changes sent together.
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+$TMUX kill-server 2>/dev/null
+
+OUT=$(mktemp)
+EXP=$(mktemp)
+trap "rm -f $OUT $EXP" 0 1 15
+
+$TMUX -f/dev/null new -d -x20 -y4 "$TMUX wait start; seq 1 100000; printf '\033[1mx\\\\'; $TMUX wait -S done; cat" ||
+	exit 1
+sleep 1
+(
+	echo "refresh-client -A '%0:screen'"
+	sleep 0.5
+	$TMUX wait -S start
+	$TMUX wait done
+	sleep 0.5
+) | $TMUX -C a >$OUT
+$TMUX kill-server 2>/dev/null
+
+# Far fewer updates than lines of output.
+[ $(grep -c '^%screen %0 ' $OUT) -lt 100 ] || exit 1
+grep -q '^%output' $OUT && exit 1
+
+# The last update should have the end of the output and the cursor.
+grep '^%screen' $OUT|tail -4 >$EXP
+cat <<EOF|cmp -s $EXP - || exit 1
+%screen-line %0 1 99999
+%screen-line %0 2 100000
+%screen-line %0 3 \\033[1mx\\\\\\033[0m\\033[39m\\033[49m
+%screen %0 20 4 2 3
+EOF
+
+exit 0
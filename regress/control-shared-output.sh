@@ -0,0 +1,65 @@
+#!/bin/sh
+
+# Attach two control clients to one pane, flood it with output and check both
+# clients get all of it, in order and the same, from the shared pane chunks.
+# The second client is read late so it falls behind the first.
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+$TMUX kill-server 2>/dev/null
+
+EXP=$(mktemp)
+OUT1=$(mktemp)
+OUT2=$(mktemp)
+OUT1A=$(mktemp)
+OUT2A=$(mktemp)
+DONE=$(mktemp)
+rm -f $DONE
+trap "rm -f $EXP $OUT1 $OUT2 $OUT1A $OUT2A $DONE" 0 1 15
+
+seq 1 200000 >$EXP
+echo END >>$EXP
+
+# Join the %output lines for the pane and undo the line ending escapes.
+output()
+{
+	awk '/^%output %0 / {
+		printf "%s", substr($0, 12)
+	}' $1|sed 's/\\015//g; s/\\012/\
+/g'
+}
+
+$TMUX -f/dev/null new -d -x80 -y24 "$TMUX wait start; seq 1 200000; echo END; cat" ||
+	exit 1
+sleep 1
+(while [ ! -f $DONE ]; do sleep 0.1; done) | $TMUX -C a >$OUT1 &
+(while [ ! -f $DONE ]; do sleep 0.1; done) | $TMUX -C a | \
+	(sleep 2; cat) >$OUT2 &
+
+n=0
+while [ "$($TMUX lsc|wc -l)" -ne 2 ]; do
+	sleep 0.1
+	n=$((n + 1))
+	[ $n -gt 50 ] && exit 1
+done
+$TMUX wait -S start
+
+n=0
+while ! output $OUT1|grep -q '^END$' || ! output $OUT2|grep -q '^END$'; do
+	sleep 0.5
+	n=$((n + 1))
+	[ $n -gt 120 ] && break
+done
+touch $DONE
+$TMUX kill-server 2>/dev/null
+wait
+
+output $OUT1 >$OUT1A
+output $OUT2 >$OUT2A
+cmp -s $OUT1A $EXP || exit 1
+cmp -s $OUT2A $EXP || exit 1
+
+exit 0
@@ -0,0 +1,82 @@
+#!/bin/sh
+
+# Search a large history in copy mode and check where each search lands.
+# Also reports how long the searches took.
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+$TMUX kill-server 2>/dev/null
+
+TMP=$(mktemp)
+OUT=$(mktemp)
+trap "rm -f $TMP $OUT" 0 1 15
+
+awk 'BEGIN {
+	for (i = 1; i <= 200000; i++) {
+		if (i == 12345) {
+			for (j = 0; j < 77; j++)
+				printf "x"
+			print "needle in a wrapped line"
+		} else if (i == 150000)
+			print "\303\234n\303\257c\303\266d\303\251 needle \303\251"
+		else if (i % 997 == 0)
+			print "Alpha beta " i " gamma"
+		else
+			print "line " i
+	}
+}' >$TMP
+
+$TMUX -f/dev/null set -g history-limit 300000 \; \
+	new -d -x80 -y10 "cat $TMP; $TMUX wait -S done; cat" || exit 1
+$TMUX wait done
+
+E=$(printf '\303\251')
+F='#{copy_cursor_x} #{copy_cursor_y} #{scroll_position} #{search_match}'
+# Searches may finish in the background, so wait for each one.
+search()
+{
+	$TMUX send -X "$@" || exit 1
+	while [ "$($TMUX display -p '#{search_running}')" = 1 ]; do
+		sleep 0.01
+	done
+	$TMUX display -p "$F"
+}
+
+START=$(date +%s%N)
+$TMUX copy-mode
+(
+	search search-backward needle
+	search search-again
+	search search-backward ALPHA
+	search search-backward "alpha beta 19940"
+	search search-backward "beta 1[0-9]{3} gamma"
+	search search-forward "line 199999"
+	search search-backward "nothing matches this"
+	$TMUX send -X history-top
+	search search-forward "$E"
+	search search-again
+) >$OUT
+END=$(date +%s%N)
+$TMUX kill-server 2>/dev/null
+
+awk -v s=$START -v e=$END 'BEGIN {
+	t = (e - s) / 1000000000
+	printf "copy-mode-search: searches took %.3f seconds\n", t
+}'
+
+cat <<EOF | cmp -s $OUT - || exit 1
+8 8 50000 needle
+77 8 187656 needle
+77 8 187656 needle
+0 8 600 Alpha beta 19940
+6 8 198007 beta 1994 gamma
+0 8 1 line 199999
+0 8 1 line 199999
+6 8 50000 $E
+15 8 50000 $E
+EOF
+
+exit 0
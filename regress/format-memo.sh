@@ -0,0 +1,45 @@
+#!/bin/sh
+
+# Some pane formats are remembered until the pane changes. Check they are
+# updated by output to the pane, clearing the history, resizing and resetting
+# the pane.
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+$TMUX kill-server 2>/dev/null
+
+$TMUX -f/dev/null new -d -x40 -y10 "seq 1 100; $TMUX wait -S done; cat" || \
+	exit 1
+$TMUX wait done
+
+B1=$($TMUX display -p '#{history_bytes}')
+B2=$($TMUX display -p '#{history_bytes}')
+[ "$B1" = "$B2" ] || exit 1
+
+$TMUX send -l 'more output' \; send Enter || exit 1
+sleep 1
+B3=$($TMUX display -p '#{history_bytes}')
+[ "$B3" != "$B2" ] || exit 1
+
+$TMUX clearhist || exit 1
+B4=$($TMUX display -p '#{history_size} #{history_bytes}')
+[ "${B4%% *}" = 0 -a "$B4" != "0 $B3" ] || exit 1
+
+[ "$($TMUX display -p '#{pane_tabs}')" = "8,16,24,32" ] || exit 1
+$TMUX set -g window-size manual \; resizew -x20 || exit 1
+[ "$($TMUX display -p '#{pane_tabs}')" = "8,16" ] || exit 1
+$TMUX kill-server 2>/dev/null
+
+$TMUX -f/dev/null new -d -x40 -y10 \
+	"printf '\033[3g'; $TMUX wait -S done; exec cat" || exit 1
+$TMUX wait done
+sleep 1
+[ -z "$($TMUX display -p '#{pane_tabs}')" ] || exit 1
+$TMUX send -R || exit 1
+[ "$($TMUX display -p '#{pane_tabs}')" = "8,16,24,32" ] || exit 1
+
+$TMUX kill-server 2>/dev/null
+exit 0
@@ -163,6 +163,11 @@ test_conditional_with_session_name "#{?pane_in_mode,abc,#{?#{==:#{session_name},
 # Some fancy stackings
 test_conditional_with_pane_in_mode "#{?#{==:#{?pane_in_mode,#{session_name},#(echo Spring)},Summer},abc,xyz}" "abc" "xyz"
 
+# Modifier arguments which are formats themselves
+test_conditional_with_session_name "#{=/#{?#{==:#{session_name},Summer},2,3}/:session_name}" "Su" "Win"
+test_conditional_with_pane_in_mode "#{e|+|:#{?pane_in_mode,1,2},3}" "4" "5"
+test_conditional_with_session_name "#{s/#{?#{==:#{session_name},Summer},mm,nt}/-/:session_name}" "Su-er" "Wi-er"
+
 
 
 # Format test for the literal option
@@ -0,0 +1,39 @@
+#!/bin/sh
+
+# History old enough to be packed should still be captured unchanged, both
+# before and after the pane is resized.
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+$TMUX kill-server 2>/dev/null
+
+TMP=$(mktemp)
+EXP=$(mktemp)
+OUT=$(mktemp)
+trap "rm -f $TMP $EXP $OUT" 0 1 15
+
+awk 'BEGIN {
+	for (i = 1; i <= 5000; i++)
+		printf "\033[3%dmline %d\033[0m %s\n", i % 8, i, (i % 7 == 0 ? "\303\251\360\237\230\200" : "x")
+}' >$TMP
+awk 'BEGIN {
+	for (i = 1; i <= 5000; i++)
+		printf "line %d %s\n", i, (i % 7 == 0 ? "\303\251\360\237\230\200" : "x")
+}' >$EXP
+
+$TMUX -f/dev/null set -g history-limit 10000 \; \
+	new -d -x40 -y10 "cat $TMP; $TMUX wait -S done; cat" || exit 1
+$TMUX wait done
+
+$TMUX capturep -pS- | head -5000 >$OUT
+cmp -s $OUT $EXP || exit 1
+
+$TMUX set -g window-size manual \; resizew -x25 || exit 1
+$TMUX capturep -pS- | head -5000 >$OUT
+cmp -s $OUT $EXP || exit 1
+
+$TMUX kill-server 2>/dev/null
+exit 0
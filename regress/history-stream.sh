@@ -0,0 +1,43 @@
+#!/bin/sh
+
+# Stream lines through a pane with a large history limit, so the history is
+# full and lines are continually aged out, and report how long it takes. Set
+# STREAM_LINES to change the number of lines (default 10000000).
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+$TMUX kill-server 2>/dev/null
+
+[ -z "$STREAM_LINES" ] && STREAM_LINES=10000000
+
+OUT=$(mktemp)
+trap "rm -f $OUT" 0 1 15
+
+$TMUX -f/dev/null set -g history-limit 500000 \; \
+	new -d -x80 -y24 "sleep 1; $TMUX wait -S start; seq 1 $STREAM_LINES; $TMUX wait -S done; cat" || exit 1
+$TMUX wait start
+START=$(date +%s%N)
+$TMUX wait done
+END=$(date +%s%N)
+
+$TMUX capturep -p|grep -v '^$'|tail -1 >$OUT
+$TMUX capturep -pS-|head -1 >>$OUT
+$TMUX kill-server 2>/dev/null
+
+awk -v s=$START -v e=$END -v n=$STREAM_LINES 'BEGIN {
+	t = (e - s) / 1000000000
+	if (t > 0)
+		printf "history-stream: %u lines in %.3f seconds (%.0f lines/s)\n", n, t, n / t
+}'
+
+# The last line should be on screen and the oldest kept in history should be
+# within the history limit of it.
+LAST=$(sed -n 1p $OUT)
+FIRST=$(sed -n 2p $OUT)
+[ "$LAST" = "$STREAM_LINES" ] || exit 1
+[ $((LAST - FIRST)) -le 500024 ] || exit 1
+
+exit 0
@@ -0,0 +1,43 @@
+#!/bin/sh
+
+# Flood a pane with printable output and report how fast the server parses it.
+# Set FLOOD_MB to change the amount of output (default 32).
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+$TMUX kill-server 2>/dev/null
+
+[ -z "$FLOOD_MB" ] && FLOOD_MB=32
+
+TMP=$(mktemp)
+OUT=$(mktemp)
+trap "rm -f $TMP $OUT" 0 1 15
+
+awk -v n=$((FLOOD_MB * 1024 * 1024 / 64)) 'BEGIN {
+	l = "the quick brown fox jumps over the lazy dog 0123456789 ABCDEF"
+	for (i = 0; i < n; i++)
+		print l
+	print "END OF FLOOD"
+}' >$TMP
+
+$TMUX -f/dev/null new -d -x80 -y24 "sleep 1; $TMUX wait -S start; cat $TMP; $TMUX wait -S done; cat" || exit 1
+$TMUX wait start
+START=$(date +%s%N)
+$TMUX wait done
+END=$(date +%s%N)
+
+$TMUX capturep -p|grep -v '^$'|tail -1 >$OUT
+$TMUX kill-server 2>/dev/null
+
+echo "END OF FLOOD"|cmp -s $OUT - || exit 1
+
+awk -v s=$START -v e=$END -v mb=$FLOOD_MB 'BEGIN {
+	t = (e - s) / 1000000000
+	if (t > 0)
+		printf "input-flood: %u MB in %.3f seconds (%.1f MB/s)\n", mb, t, mb / t
+}'
+
+exit 0
@@ -0,0 +1,28 @@
+#!/bin/sh
+
+# The current command and path of a pane are kept for a while but should
+# follow the shell when there is output from the pane, and follow a process
+# started without any output once they expire.
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+$TMUX kill-server 2>/dev/null
+
+$TMUX -f/dev/null new -d -x40 -y10 "cd /; exec sh" || exit 1
+sleep 1
+[ "$($TMUX display -p '#{pane_current_command}:#{pane_current_path}')" = \
+    "sh:/" ] || exit 1
+
+$TMUX send 'cd /usr' Enter || exit 1
+sleep 1
+[ "$($TMUX display -p '#{pane_current_path}')" = "/usr" ] || exit 1
+
+$TMUX send 'exec sleep 100' Enter || exit 1
+sleep 3
+[ "$($TMUX display -p '#{pane_current_command}')" = "sleep" ] || exit 1
+
+$TMUX kill-server 2>/dev/null
+exit 0
@@ -0,0 +1,46 @@
+#!/bin/sh
+
+# Scroll a region of a pane which is not the full width of the terminal, so
+# it has to be redrawn, and check a client shows the same as the pane. The
+# client is run inside another tmux to see what it has drawn.
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+TMUX2="$TEST_TMUX -Ltest2"
+$TMUX kill-server 2>/dev/null
+$TMUX2 kill-server 2>/dev/null
+
+TMP=$(mktemp)
+OUT=$(mktemp)
+EXP=$(mktemp)
+trap "rm -f $TMP $OUT $EXP" 0 1 15
+
+cat <<EOF >$TMP
+sleep 1
+seq 1 30
+printf '\033[3;15r\033[15;1H'
+for i in \$(seq 1 200); do
+	echo scroll \$i
+	[ \$((i % 20)) = 0 ] && sleep 0.05
+done
+printf '\033[5;1Hchanged\033[3;1H\033M\033[r\033[10;1H\033[2L\033[12;1H\033[3M'
+$TMUX wait -S done
+cat
+EOF
+
+$TMUX -f/dev/null new -d -x80 -y24 "sh $TMP" \; set -g status off \; \
+	splitw -hd "seq 1 50; cat" || exit 1
+$TMUX2 -f/dev/null new -d -x80 -y24 "$TMUX attach" || exit 1
+$TMUX wait done
+sleep 1
+
+$TMUX2 capturep -p|cut -c1-40|sed 's/ *$//' >$OUT
+$TMUX capturep -pt%0|sed 's/ *$//' >$EXP
+$TMUX2 kill-server 2>/dev/null
+$TMUX kill-server 2>/dev/null
+cmp -s $OUT $EXP || exit 1
+
+exit 0
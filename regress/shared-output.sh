@@ -0,0 +1,52 @@
+#!/bin/sh
+
+# Attach two clients with the same terminal so output can be shared between
+# them, write some output to a pane and check both clients show the same as
+# the pane. Each client is run inside another tmux to see what it has drawn.
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+TMUX2="$TEST_TMUX -Ltest2"
+TMUX3="$TEST_TMUX -Ltest3"
+$TMUX kill-server 2>/dev/null
+$TMUX2 kill-server 2>/dev/null
+$TMUX3 kill-server 2>/dev/null
+
+TMP=$(mktemp)
+OUT=$(mktemp)
+OUT2=$(mktemp)
+EXP=$(mktemp)
+trap "rm -f $TMP $OUT $OUT2 $EXP" 0 1 15
+
+cat <<EOF >$TMP
+$TMUX wait start
+for i in \$(seq 1 100); do
+	printf '\033[3%dmline \033[1m%d\033[0m\n' \$((i % 8)) \$i
+done
+printf '\033[3;15r\033[15;1H'
+seq 1 50
+printf '\033[r\033[5;1Hchanged\033[10;1H\033[2L\033[12;1H\033[3M\033[20;1H'
+$TMUX wait -S done
+cat
+EOF
+
+$TMUX -f/dev/null new -d -x80 -y24 "sh $TMP" \; set -g status off || exit 1
+$TMUX2 -f/dev/null new -d -x80 -y24 "$TMUX attach" || exit 1
+$TMUX3 -f/dev/null new -d -x80 -y24 "$TMUX attach" || exit 1
+sleep 1
+$TMUX wait -S start \; wait done
+sleep 1
+
+$TMUX2 capturep -p|sed 's/ *$//' >$OUT
+$TMUX3 capturep -p|sed 's/ *$//' >$OUT2
+$TMUX capturep -p|sed 's/ *$//' >$EXP
+$TMUX3 kill-server 2>/dev/null
+$TMUX2 kill-server 2>/dev/null
+$TMUX kill-server 2>/dev/null
+cmp -s $OUT $EXP || exit 1
+cmp -s $OUT2 $EXP || exit 1
+
+exit 0
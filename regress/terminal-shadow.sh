@@ -0,0 +1,46 @@
+#!/bin/sh
+
+# Switch between windows with terminal-shadow on, changing a window while it
+# is not visible, and check a client shows the same as the pane. The client
+# is run inside another tmux to see what it has drawn.
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+TMUX2="$TEST_TMUX -Ltest2"
+$TMUX kill-server 2>/dev/null
+$TMUX2 kill-server 2>/dev/null
+
+TMP=$(mktemp)
+OUT=$(mktemp)
+EXP=$(mktemp)
+trap "rm -f $TMP $OUT $EXP" 0 1 15
+
+cat <<EOF >$TMP
+seq 1 30
+printf '\033[1;31mred\033[0m \033[44mblue\033[0m\n'
+$TMUX wait -S ready
+$TMUX wait changed
+printf '\033[5;3Hchanged\033[10;1H\033[Kcleared\033[20;1H'
+$TMUX wait -S done
+cat
+EOF
+
+$TMUX -f/dev/null new -d -x80 -y24 "sh $TMP" \; set -g status off \; \
+	set -g terminal-shadow on \; neww -d "seq 100 200; cat" || exit 1
+$TMUX wait ready
+$TMUX2 -f/dev/null new -d -x80 -y24 "$TMUX attach" || exit 1
+sleep 1
+$TMUX next \; run -d0.5 \; next \; run -d0.5 \; next \; run -d0.5
+$TMUX wait -S changed \; wait done
+$TMUX next \; run -d0.5 \; next \; run -d0.5
+
+$TMUX2 capturep -p|sed 's/ *$//' >$OUT
+$TMUX capturep -p|sed 's/ *$//' >$EXP
+$TMUX2 kill-server 2>/dev/null
+$TMUX kill-server 2>/dev/null
+cmp -s $OUT $EXP || exit 1
+
+exit 0
@@ -0,0 +1,42 @@
+#!/bin/sh
+
+# Characters which are stored in the UTF-8 table are freed when the history
+# holding them is trimmed and their space is reused. Check that what is left
+# in the history is still captured correctly, both for characters seen on
+# every line and characters seen only once.
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+$TMUX kill-server 2>/dev/null
+
+TMP=$(mktemp)
+EXP=$(mktemp)
+OUT=$(mktemp)
+trap "rm -f $TMP $EXP $OUT" 0 1 15
+
+LC_ALL=C awk 'BEGIN {
+	for (i = 1; i <= 3000; i++) {
+		k = i % 256
+		printf "line %d \360\237%c%c a\314%c\315%c \360\237\230\200\n", \
+		    i, 140 + int(k / 64), 128 + k % 64, 128 + i % 64, \
+		    128 + int(i / 64) % 48
+	}
+}' >$TMP
+tail -40 $TMP >$EXP
+
+$TMUX -f/dev/null set -g history-limit 50 \; \
+	new -d -x40 -y10 "cat $TMP; $TMUX wait -S done; cat" || exit 1
+$TMUX wait done
+
+$TMUX capturep -pS- | grep ^line | tail -40 >$OUT
+cmp -s $OUT $EXP || exit 1
+
+$TMUX set -g window-size manual \; resizew -x25 \; resizew -x40 || exit 1
+$TMUX capturep -pS- | grep ^line | tail -40 >$OUT
+cmp -s $OUT $EXP || exit 1
+
+$TMUX kill-server 2>/dev/null
+exit 0
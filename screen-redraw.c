@@ -27,7 +27,7 @@ static void	screen_redraw_draw_borders(struct screen_redraw_ctx *);
 static void	screen_redraw_draw_panes(struct screen_redraw_ctx *);
 static void	screen_redraw_draw_status(struct screen_redraw_ctx *);
 static void	screen_redraw_draw_pane(struct screen_redraw_ctx *,
-		    struct window_pane *);
+		    struct window_pane *, int);
 
 #define CELL_INSIDE 0
 #define CELL_LEFTRIGHT 1
@@ -601,9 +601,9 @@ screen_redraw_screen(struct client *c)
 	tty_reset(&c->tty);
 }
 
-/* Redraw a single pane. */
+/* Redraw a single pane, or only the lines marked to be redrawn. */
 void
-screen_redraw_pane(struct client *c, struct window_pane *wp)
+screen_redraw_pane(struct client *c, struct window_pane *wp, int lines)
 {
 	struct screen_redraw_ctx	 ctx;
 
@@ -614,7 +614,7 @@ screen_redraw_pane(struct client *c, struct window_pane *wp)
 	tty_update_mode(&c->tty, c->tty.mode, NULL);
 	tty_sync_start(&c->tty);
 
-	screen_redraw_draw_pane(&ctx, wp);
+	screen_redraw_draw_pane(&ctx, wp, lines);
 
 	tty_reset(&c->tty);
 }
@@ -719,7 +719,7 @@ screen_redraw_draw_panes(struct screen_redraw_ctx *ctx)
 
 	TAILQ_FOREACH(wp, &w->panes, entry) {
 		if (window_pane_visible(wp))
-			screen_redraw_draw_pane(ctx, wp);
+			screen_redraw_draw_pane(ctx, wp, 0);
 	}
 }
 
@@ -747,7 +747,8 @@ screen_redraw_draw_status(struct screen_redraw_ctx *ctx)
 
 /* Draw one pane. */
 static void
-screen_redraw_draw_pane(struct screen_redraw_ctx *ctx, struct window_pane *wp)
+screen_redraw_draw_pane(struct screen_redraw_ctx *ctx, struct window_pane *wp,
+    int lines)
 {
 	struct client	*c = ctx->c;
 	struct window	*w = c->session->curw->window;
@@ -769,6 +770,9 @@ screen_redraw_draw_pane(struct screen_redraw_ctx *ctx, struct window_pane *wp)
 	for (j = 0; j < wp->sy; j++) {
 		if (wp->yoff + j < ctx->oy || wp->yoff + j >= ctx->oy + ctx->sy)
 			continue;
+		if (lines &&
+		    (j >= wp->redraw_size || !bit_test(wp->redraw_lines, j)))
+			continue;
 		y = top + wp->yoff + j - ctx->oy;
 
 		if (wp->xoff >= ctx->ox &&
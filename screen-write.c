@@ -97,14 +97,15 @@ screen_write_set_cursor(struct screen_write_ctx *ctx, int cx, int cy)
 		evtimer_add(&w->offset_timer, &tv);
 }
 
-/* Do a full redraw. */
+/* Redraw the lines changed by a command. */
 static void
 screen_write_redraw_cb(const struct tty_ctx *ttyctx)
 {
 	struct window_pane	*wp = ttyctx->arg;
 
 	if (wp != NULL)
-		wp->flags |= PANE_REDRAW;
+		window_pane_redraw_lines(wp, ttyctx->redraw_py,
+		    ttyctx->redraw_ny);
 }
 
 /* Update context for client. */
@@ -120,13 +121,23 @@ screen_write_set_client_cb(struct tty_ctx *ttyctx, struct client *c)
 
 	if (wp->flags & (PANE_REDRAW|PANE_DROP))
 		return (-1);
+	if (wp->flags & PANE_REDRAWLINES) {
+		/*
+		 * Some lines are already waiting to be redrawn, so the client
+		 * may not match the screen - redraw these lines with them.
+		 */
+		window_pane_redraw_lines(wp, ttyctx->redraw_py,
+		    ttyctx->redraw_ny);
+		return (-1);
+	}
 	if (c->flags & CLIENT_REDRAWPANES) {
 		/*
 		 * Redraw is already deferred to redraw another pane - redraw
 		 * this one also when that happens.
 		 */
 		log_debug("adding %%%u to deferred redraw", wp->id);
-		wp->flags |= PANE_REDRAW;
+		window_pane_redraw_lines(wp, ttyctx->redraw_py,
+		    ttyctx->redraw_ny);
 		return (-1);
 	}
 
@@ -169,6 +180,9 @@ screen_write_initctx(struct screen_write_ctx *ctx, struct tty_ctx *ttyctx,
 	ttyctx->orlower = s->rlower;
 	ttyctx->orupper = s->rupper;
 
+	ttyctx->redraw_py = s->cy;
+	ttyctx->redraw_ny = 1;
+
 	if (ctx->init_ctx_cb != NULL)
 		ctx->init_ctx_cb(ctx, ttyctx);
 	else {
@@ -188,6 +202,22 @@ screen_write_initctx(struct screen_write_ctx *ctx, struct tty_ctx *ttyctx,
 	}
 }
 
+/* Set command to redraw the whole screen if it cannot be written. */
+static void
+screen_write_redraw_all(struct tty_ctx *ttyctx)
+{
+	ttyctx->redraw_py = 0;
+	ttyctx->redraw_ny = ttyctx->sy;
+}
+
+/* Set command to redraw the scroll region if it cannot be written. */
+static void
+screen_write_redraw_region(struct tty_ctx *ttyctx)
+{
+	ttyctx->redraw_py = ttyctx->orupper;
+	ttyctx->redraw_ny = ttyctx->orlower - ttyctx->orupper + 1;
+}
+
 /* Make write list. */
 void
 screen_write_make_list(struct screen *s)
@@ -908,6 +938,7 @@ screen_write_alignmenttest(struct screen_write_ctx *ctx)
 	screen_write_initctx(ctx, &ttyctx, 1);
 
 	screen_write_collect_clear(ctx, 0, screen_size_y(s) - 1);
+	screen_write_redraw_all(&ttyctx);
 	tty_write(tty_cmd_alignmenttest, &ttyctx);
 }
 
@@ -1014,6 +1045,7 @@ screen_write_insertline(struct screen_write_ctx *ctx, u_int ny, u_int bg)
 
 		screen_write_initctx(ctx, &ttyctx, 1);
 		ttyctx.bg = bg;
+		ttyctx.redraw_ny = screen_size_y(s) - s->cy;
 
 		grid_view_insert_lines(gd, s->cy, ny, bg);
 
@@ -1030,6 +1062,7 @@ screen_write_insertline(struct screen_write_ctx *ctx, u_int ny, u_int bg)
 
 	screen_write_initctx(ctx, &ttyctx, 1);
 	ttyctx.bg = bg;
+	ttyctx.redraw_ny = s->rlower + 1 - s->cy;
 
 	if (s->cy < s->rupper || s->cy > s->rlower)
 		grid_view_insert_lines(gd, s->cy, ny, bg);
@@ -1061,6 +1094,7 @@ screen_write_deleteline(struct screen_write_ctx *ctx, u_int ny, u_int bg)
 
 		screen_write_initctx(ctx, &ttyctx, 1);
 		ttyctx.bg = bg;
+		ttyctx.redraw_ny = screen_size_y(s) - s->cy;
 
 		grid_view_delete_lines(gd, s->cy, ny, bg);
 
@@ -1077,6 +1111,7 @@ screen_write_deleteline(struct screen_write_ctx *ctx, u_int ny, u_int bg)
 
 	screen_write_initctx(ctx, &ttyctx, 1);
 	ttyctx.bg = bg;
+	ttyctx.redraw_ny = s->rlower + 1 - s->cy;
 
 	if (s->cy < s->rupper || s->cy > s->rlower)
 		grid_view_delete_lines(gd, s->cy, ny, bg);
@@ -1198,6 +1233,7 @@ screen_write_reverseindex(struct screen_write_ctx *ctx, u_int bg)
 
 		screen_write_initctx(ctx, &ttyctx, 1);
 		ttyctx.bg = bg;
+		screen_write_redraw_region(&ttyctx);
 
 		tty_write(tty_cmd_reverseindex, &ttyctx);
 	} else if (s->cy > 0)
@@ -1305,6 +1341,7 @@ screen_write_scrolldown(struct screen_write_ctx *ctx, u_int lines, u_int bg)
 
 	screen_write_collect_flush(ctx, 0, __func__);
 	ttyctx.num = lines;
+	screen_write_redraw_region(&ttyctx);
 	tty_write(tty_cmd_scrolldown, &ttyctx);
 }
 
@@ -1338,6 +1375,10 @@ screen_write_clearendofscreen(struct screen_write_ctx *ctx, u_int bg)
 
 	screen_write_collect_clear(ctx, s->cy + 1, sy - (s->cy + 1));
 	screen_write_collect_flush(ctx, 0, __func__);
+	if (ttyctx.ocx == 0 && ttyctx.ocy == 0)
+		screen_write_redraw_all(&ttyctx);
+	else
+		ttyctx.redraw_ny = sy - ttyctx.ocy;
 	tty_write(tty_cmd_clearendofscreen, &ttyctx);
 }
 
@@ -1361,6 +1402,8 @@ screen_write_clearstartofscreen(struct screen_write_ctx *ctx, u_int bg)
 
 	screen_write_collect_clear(ctx, 0, s->cy);
 	screen_write_collect_flush(ctx, 0, __func__);
+	ttyctx.redraw_py = 0;
+	ttyctx.redraw_ny = ttyctx.ocy + 1;
 	tty_write(tty_cmd_clearstartofscreen, &ttyctx);
 }
 
@@ -1382,6 +1425,7 @@ screen_write_clearscreen(struct screen_write_ctx *ctx, u_int bg)
 		grid_view_clear(s->grid, 0, 0, sx, sy, bg);
 
 	screen_write_collect_clear(ctx, 0, sy);
+	screen_write_redraw_all(&ttyctx);
 	tty_write(tty_cmd_clearscreen, &ttyctx);
 }
 
@@ -1546,6 +1590,7 @@ screen_write_collect_flush(struct screen_write_ctx *ctx, int scroll_only,
 		screen_write_initctx(ctx, &ttyctx, 1);
 		ttyctx.num = ctx->scrolled;
 		ttyctx.bg = ctx->bg;
+		screen_write_redraw_region(&ttyctx);
 		tty_write(tty_cmd_scrollup, &ttyctx);
 	}
 	ctx->scrolled = 0;
@@ -1696,6 +1741,67 @@ screen_write_collect_add(struct screen_write_ctx *ctx,
 	ctx->s->write_list[s->cy].data[s->cx + ci->used++] = gc->data.data[0];
 }
 
+/*
+ * Write a run of printable ASCII characters which all have the same attributes
+ * as gc. The characters are copied into the collected line in as few pieces as
+ * the line width allows rather than one at a time.
+ */
+void
+screen_write_collect_add_ascii(struct screen_write_ctx *ctx,
+    const struct grid_cell *gc, const u_char *buf, size_t len)
+{
+	struct screen				*s = ctx->s;
+	struct screen_write_collect_item	*ci;
+	struct screen_write_collect_line	*cl;
+	struct grid_cell			 tmp_gc;
+	u_int					 sx = screen_size_x(s);
+	size_t					 n;
+
+	if ((gc->attr & GRID_ATTR_CHARSET) ||
+	    (~s->mode & MODE_WRAP) ||
+	    (s->mode & MODE_INSERT) ||
+	    s->sel != NULL) {
+		memcpy(&tmp_gc, gc, sizeof tmp_gc);
+		for (n = 0; n < len; n++) {
+			utf8_set(&tmp_gc.data, buf[n]);
+			screen_write_collect_add(ctx, &tmp_gc);
+		}
+		return;
+	}
+
+	while (len != 0) {
+		if (s->cx > sx - 1 || ctx->item->used > sx - 1 - s->cx)
+			screen_write_collect_end(ctx);
+		ci = ctx->item; /* may have changed */
+
+		if (s->cx > sx - 1) {
+			log_debug("%s: wrapped at %u,%u", __func__, s->cx,
+			    s->cy);
+			ci->wrapped = 1;
+			screen_write_linefeed(ctx, 1, 8);
+			screen_write_set_cursor(ctx, 0, -1);
+		}
+
+		if (ci->used == 0) {
+			memcpy(&ci->gc, gc, sizeof ci->gc);
+			utf8_set(&ci->gc.data, *buf);
+		}
+		cl = &s->write_list[s->cy];
+		if (cl->data == NULL)
+			cl->data = xmalloc(sx);
+
+		n = sx - s->cx - ci->used;
+		if (n > len)
+			n = len;
+		memcpy(cl->data + s->cx + ci->used, buf, n);
+		ci->used += n;
+		ctx->cells += n;
+
+		buf += n;
+		len -= n;
+	}
+}
+
 /* Write cell data. */
 void
 screen_write_cell(struct screen_write_ctx *ctx, const struct grid_cell *gc)
@@ -1991,6 +2097,7 @@ screen_write_alternateon(struct screen_write_ctx *ctx, struct grid_cell *gc,
 	screen_alternate_on(ctx->s, gc, cursor);
 
 	screen_write_initctx(ctx, &ttyctx, 1);
+	screen_write_redraw_all(&ttyctx);
 	ttyctx.redraw_cb(&ttyctx);
 }
 
@@ -2007,5 +2114,6 @@ screen_write_alternateoff(struct screen_write_ctx *ctx, struct grid_cell *gc,
 	screen_alternate_off(ctx->s, gc, cursor);
 
 	screen_write_initctx(ctx, &ttyctx, 1);
+	screen_write_redraw_all(&ttyctx);
 	ttyctx.redraw_cb(&ttyctx);
 }
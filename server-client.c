@@ -1371,7 +1371,11 @@ server_client_loop(void)
 				server_client_check_pane_resize(wp);
 				server_client_check_pane_buffer(wp);
 			}
-			wp->flags &= ~PANE_REDRAW;
+			if (wp->flags & PANE_REDRAWLINES) {
+				bit_nclear(wp->redraw_lines, 0,
+				    wp->redraw_size - 1);
+			}
+			wp->flags &= ~(PANE_REDRAW|PANE_REDRAWLINES);
 		}
 		check_window_name(w);
 	}
@@ -1491,17 +1495,23 @@ server_client_check_pane_buffer(struct window_pane *wp)
 	size_t				 minimum;
 	struct client			*c;
 	struct window_pane_offset	*wpo;
+	struct window_pane_chunk	*wpc;
 	int				 off = 1, flag;
 	u_int				 attached_clients = 0;
-	size_t				 new_size;
 
 	/*
 	 * Work out the minimum used size. This is the most that can be removed
-	 * from the buffer.
+	 * from the buffer. Control clients only need the data they have
+	 * queued, and the first chunk is the oldest of that.
 	 */
 	minimum = wp->offset.used;
 	if (wp->pipe_fd != -1 && wp->pipe_offset.used < minimum)
 		minimum = wp->pipe_offset.used;
+	wpc = TAILQ_FIRST(&wp->chunks);
+	if (wpc != NULL && wpc->start < minimum)
+		minimum = wpc->start;
+
+	/* Check if any client can take more output. */
 	TAILQ_FOREACH(c, &clients, entry) {
 		if (c->session == NULL)
 			continue;
@@ -1509,22 +1519,13 @@ server_client_check_pane_buffer(struct window_pane *wp)
 
 		if (~c->flags & CLIENT_CONTROL) {
 			off = 0;
-			continue;
+			break;
 		}
 		wpo = control_pane_offset(c, wp, &flag);
-		if (wpo == NULL) {
+		if (wpo == NULL || !flag) {
 			off = 0;
-			continue;
+			break;
 		}
-		if (!flag)
-			off = 0;
-
-		window_pane_get_new_data(wp, wpo, &new_size);
-		log_debug("%s: %s has %zu bytes used and %zu left for %%%u",
-		    __func__, c->name, wpo->used - wp->base_offset, new_size,
-		    wp->id);
-		if (wpo->used < minimum)
-			minimum = wpo->used;
 	}
 	if (attached_clients == 0)
 		off = 0;
@@ -1546,6 +1547,10 @@ server_client_check_pane_buffer(struct window_pane *wp)
 		wp->offset.used -= wp->base_offset;
 		if (wp->pipe_fd != -1)
 			wp->pipe_offset.used -= wp->base_offset;
+		TAILQ_FOREACH(wpc, &wp->chunks, entry) {
+			wpc->start -= wp->base_offset;
+			wpc->end -= wp->base_offset;
+		}
 		TAILQ_FOREACH(c, &clients, entry) {
 			if (c->session == NULL || (~c->flags & CLIENT_CONTROL))
 				continue;
@@ -1848,7 +1853,7 @@ server_client_check_redraw(struct client *c)
 		needed = 1;
 	else {
 		TAILQ_FOREACH(wp, &w->panes, entry) {
-			if (wp->flags & PANE_REDRAW) {
+			if (wp->flags & (PANE_REDRAW|PANE_REDRAWLINES)) {
 				needed = 1;
 				break;
 			}
@@ -1865,9 +1870,13 @@ server_client_check_redraw(struct client *c)
 			evtimer_add(&ev, &tv);
 		}
 
+		/*
+		 * The lines to redraw are only kept until the end of the loop,
+		 * so a deferred redraw is of the whole pane.
+		 */
 		if (~c->flags & CLIENT_REDRAWWINDOW) {
 			TAILQ_FOREACH(wp, &w->panes, entry) {
-				if (wp->flags & PANE_REDRAW) {
+				if (wp->flags & (PANE_REDRAW|PANE_REDRAWLINES)) {
 					log_debug("%s: pane %%%u needs redraw",
 					    c->name, wp->id);
 					c->redraw_panes |= (1 << bit);
@@ -1896,7 +1905,7 @@ server_client_check_redraw(struct client *c)
 	if (~c->flags & CLIENT_REDRAWWINDOW) {
 		/*
 		 * If not redrawing the entire window, check whether each pane
-		 * needs to be redrawn.
+		 * or only some of its lines need to be redrawn.
 		 */
 		TAILQ_FOREACH(wp, &w->panes, entry) {
 			redraw = 0;
@@ -1905,10 +1914,15 @@ server_client_check_redraw(struct client *c)
 			else if (c->flags & CLIENT_REDRAWPANES)
 				redraw = !!(c->redraw_panes & (1 << bit));
 			bit++;
-			if (!redraw)
-				continue;
-			log_debug("%s: redrawing pane %%%u", __func__, wp->id);
-			screen_redraw_pane(c, wp);
+			if (redraw) {
+				log_debug("%s: redrawing pane %%%u", __func__,
+				    wp->id);
+				screen_redraw_pane(c, wp, 0);
+			} else if (wp->flags & PANE_REDRAWLINES) {
+				log_debug("%s: redrawing lines of pane %%%u",
+				    __func__, wp->id);
+				screen_redraw_pane(c, wp, 1);
+			}
 		}
 		c->redraw_panes = 0;
 		c->flags &= ~CLIENT_REDRAWPANES;
@@ -2374,6 +2388,8 @@ server_client_control_flags(struct client *c, const char *next)
 		return (CLIENT_CONTROL_NOOUTPUT);
 	if (strcmp(next, "wait-exit") == 0)
 		return (CLIENT_CONTROL_WAITEXIT);
+	if (strcmp(next, "base64-output") == 0)
+		return (CLIENT_CONTROL_BASE64);
 	return (0);
 }
 
@@ -2436,6 +2452,8 @@ server_client_get_flags(struct client *c)
 		strlcat(s, "no-output,", sizeof s);
 	if (c->flags & CLIENT_CONTROL_WAITEXIT)
 		strlcat(s, "wait-exit,", sizeof s);
+	if (c->flags & CLIENT_CONTROL_BASE64)
+		strlcat(s, "base64-output,", sizeof s);
 	if (c->flags & CLIENT_CONTROL_PAUSEAFTER) {
 		xsnprintf(tmp, sizeof tmp, "pause-after=%u,",
 		    c->pause_age / 1000);
@@ -307,6 +307,7 @@ server_destroy_pane(struct window_pane *wp, int notify)
 		wp->event = NULL;
 		close(wp->fd);
 		wp->fd = -1;
+		wp->flags &= ~(PANE_NAMESAMPLED|PANE_CWDSAMPLED);
 	}
 
 	if (options_get_number(wp->options, "remain-on-exit")) {
@@ -320,6 +321,7 @@ server_destroy_pane(struct window_pane *wp, int notify)
 		if (notify)
 			notify_pane("pane-died", wp);
 
+		format_free_memos(&wp->memos);
 		screen_write_start_pane(&ctx, wp, &wp->base);
 		screen_write_scrollregion(&ctx, 0, screen_size_y(ctx.s) - 1);
 		screen_write_cursormove(&ctx, 0, screen_size_y(ctx.s) - 1, 0);
@@ -250,10 +250,12 @@ spawn_pane(struct spawn_context *sc, char **cause)
 		}
 		window_pane_reset_mode_all(sc->wp0);
 		screen_reinit(&sc->wp0->base);
+		format_free_memos(&sc->wp0->memos);
 		input_free(sc->wp0->ictx);
 		sc->wp0->ictx = NULL;
 		new_wp = sc->wp0;
-		new_wp->flags &= ~(PANE_STATUSREADY|PANE_STATUSDRAWN);
+		new_wp->flags &= ~(PANE_STATUSREADY|PANE_STATUSDRAWN|
+		    PANE_NAMESAMPLED|PANE_CWDSAMPLED);
 	} else if (sc->lc == NULL) {
 		new_wp = window_add_pane(w, NULL, hlimit, sc->flags);
 		layout_init(w, new_wp);
@@ -64,6 +64,7 @@ struct session;
 struct tty_ctx;
 struct tmuxpeer;
 struct tmuxproc;
+struct window_copy_regex;
 struct winlink;
 
 /* Client-server protocol version. */
@@ -87,6 +88,12 @@ struct winlink;
 /* Automatic name refresh interval, in microseconds. Must be < 1 second. */
 #define NAME_INTERVAL 500000
 
+/*
+ * How long the foreground process name and directory of a pane are kept if
+ * there is no output, in seconds.
+ */
+#define PANE_SAMPLE_INTERVAL 2
+
 /* Default pixel cell sizes. */
 #define DEFAULT_XPIXEL 16
 #define DEFAULT_YPIXEL 32
@@ -663,6 +670,7 @@ enum utf8_state {
 #define GRID_LINE_WRAPPED 0x1
 #define GRID_LINE_EXTENDED 0x2
 #define GRID_LINE_DEAD 0x4
+#define GRID_LINE_PACKED 0x8
 
 /* Grid cell data. */
 struct grid_cell {
@@ -698,13 +706,24 @@ struct grid_cell_entry {
 	};
 } __packed;
 
-/* Grid line. */
+/*
+ * Grid line. If GRID_LINE_PACKED is set, the cells are held in a block of
+ * packed history lines instead of celldata and extddata.
+ */
+struct grid_arena;
+struct grid_block;
 struct grid_line {
 	u_int			 cellused;
 	u_int			 cellsize;
-	struct grid_cell_entry	*celldata;
+	union {
+		struct grid_cell_entry	*celldata;
+		struct grid_block	*block;
+	};
 
-	u_int			 extdsize;
+	union {
+		u_int			 extdsize;
+		u_int			 blockline;
+	};
 	struct grid_extd_entry	*extddata;
 
 	int			 flags;
@@ -721,8 +740,13 @@ struct grid {
 	u_int			 hscrolled;
 	u_int			 hsize;
 	u_int			 hlimit;
+	u_int			 hpacked;
 
 	struct grid_line	*linedata;
+	u_int			 linestart;
+	u_int			 linesize;
+
+	struct grid_arena	*arena;
 };
 
 /* Style alignment. */
@@ -917,6 +941,25 @@ struct window_pane_offset {
 	size_t	used;
 };
 
+/*
+ * Chunk of pane buffer queued for control clients. There is one for each time
+ * output is queued, shared by all the clients it is queued for. While any
+ * client still needs it, the buffer is not drained past its start.
+ */
+struct window_pane_chunk {
+	struct window_pane	*wp;	/* NULL if the pane is gone */
+	size_t			 start;
+	size_t			 end;
+	u_int			 references;
+
+	TAILQ_ENTRY(window_pane_chunk) entry;
+};
+TAILQ_HEAD(window_pane_chunks, window_pane_chunk);
+
+/* Format values remembered until the object they belong to changes. */
+struct format_memo;
+RB_HEAD(format_memos, format_memo);
+
 /* Child window structure. */
 struct window_pane {
 	u_int		 id;
@@ -952,6 +995,12 @@ struct window_pane {
 #define PANE_EMPTY 0x800
 #define PANE_STYLECHANGED 0x1000
 #define PANE_RESIZENOW 0x2000
+#define PANE_REDRAWLINES 0x4000
+#define PANE_NAMESAMPLED 0x8000
+#define PANE_CWDSAMPLED 0x10000
+
+	bitstr_t	*redraw_lines;	/* lines to redraw if PANE_REDRAWLINES */
+	u_int		 redraw_size;
 
 	int		 argc;
 	char	       **argv;
@@ -967,6 +1016,7 @@ struct window_pane {
 
 	struct window_pane_offset offset;
 	size_t		 base_offset;
+	struct window_pane_chunks chunks;
 
 	struct event	 resize_timer;
 	struct event	 force_timer;
@@ -991,10 +1041,18 @@ struct window_pane {
 
 	char		*searchstr;
 	int		 searchregex;
+	struct window_copy_regex *searchcache;
 
 	size_t		 written;
 	size_t		 skipped;
 
+	struct format_memos memos;
+
+	char		*sample_name;
+	struct timeval	 sample_name_time;
+	char		*sample_cwd;
+	struct timeval	 sample_cwd_time;
+
 	int		 border_gc_set;
 	struct grid_cell border_gc;
 
@@ -1247,6 +1305,7 @@ struct tty_key {
 };
 
 struct tty_code;
+struct tty_shadow;
 struct tty_term {
 	char		*name;
 	struct tty	*tty;
@@ -1319,9 +1378,11 @@ struct tty {
 #define TTY_HAVEDA 0x100
 #define TTY_HAVEXDA 0x200
 #define TTY_SYNCING 0x400
+#define TTY_SHADOWSET 0x800
 	int		 flags;
 
 	struct tty_term	*term;
+	struct tty_shadow *shadow;
 
 	u_int		 mouse_last_x;
 	u_int		 mouse_last_y;
@@ -1363,6 +1424,13 @@ struct tty_ctx {
 	u_int		 orupper;
 	u_int		 orlower;
 
+	/*
+	 * Lines changed by the command. If it cannot be written to a client,
+	 * these lines are redrawn instead.
+	 */
+	u_int		 redraw_py;
+	u_int		 redraw_ny;
+
 	/* Target region (usually pane) offset and size. */
 	u_int		 xoff;
 	u_int		 yoff;
@@ -1648,6 +1716,7 @@ struct client {
 #define CLIENT_ACTIVEPANE 0x80000000ULL
 #define CLIENT_CONTROL_PAUSEAFTER 0x100000000ULL
 #define CLIENT_CONTROL_WAITEXIT 0x200000000ULL
+#define CLIENT_CONTROL_BASE64 0x400000000ULL
 #define CLIENT_ALLREDRAWFLAGS		\
 	(CLIENT_REDRAWWINDOW|		\
 	 CLIENT_REDRAWSTATUS|		\
@@ -1921,6 +1990,8 @@ struct format_tree;
 struct format_modifier;
 typedef char *(*format_cb)(struct format_tree *);
 const char	*format_skip(const char *, const char *);
+void		 format_free_memos(struct format_memos *);
+void		 format_invalidate_memos(void);
 int		 format_true(const char *);
 struct format_tree *format_create(struct client *, struct cmdq_item *, int,
 		     int);
@@ -2078,6 +2149,7 @@ int	tty_window_offset(struct tty *, u_int *, u_int *, u_int *, u_int *);
 void	tty_update_window_offset(struct window *);
 void	tty_update_client_offset(struct client *);
 void	tty_raw(struct tty *, const char *);
+void	tty_shadow_invalidate_all(struct tty *);
 void	tty_attributes(struct tty *, const struct grid_cell *,
 	    const struct grid_cell *, int *);
 void	tty_reset(struct tty *);
@@ -2147,6 +2219,9 @@ struct tty_term *tty_term_create(struct tty *, char *, int *, int, char **);
 void		 tty_term_free(struct tty_term *);
 int		 tty_term_has(struct tty_term *, enum tty_code_code);
 const char	*tty_term_string(struct tty_term *, enum tty_code_code);
+size_t		 tty_term_length(struct tty_term *, enum tty_code_code);
+const char	*tty_term_format(struct tty_term *, enum tty_code_code, int,
+		     int, int, size_t *);
 const char	*tty_term_string1(struct tty_term *, enum tty_code_code, int);
 const char	*tty_term_string2(struct tty_term *, enum tty_code_code, int,
 		     int);
@@ -2493,6 +2568,13 @@ int	 colour_256to16(int);
 const char *attributes_tostring(int);
 int	 attributes_fromstring(const char *);
 
+/* grid-arena.c */
+struct grid_arena *grid_arena_create(void);
+void	 grid_arena_destroy(struct grid_arena *);
+void	*grid_arena_reallocarray(struct grid_arena *, void *, size_t, size_t);
+void	 grid_arena_free(struct grid_arena *, void *);
+void	 grid_arena_get_size(struct grid_arena *, u_int *, size_t *, size_t *);
+
 /* grid.c */
 extern const struct grid_cell grid_default_cell;
 void	 grid_empty_line(struct grid *, u_int, u_int);
@@ -2514,6 +2596,7 @@ void	 grid_set_padding(struct grid *, u_int, u_int);
 void	 grid_set_cells(struct grid *, u_int, u_int, const struct grid_cell *,
 	     const char *, size_t);
 struct grid_line *grid_get_line(struct grid *, u_int);
+void	 grid_get_size(struct grid *, u_int *, u_int *, size_t *);
 void	 grid_adjust_lines(struct grid *, u_int);
 void	 grid_clear(struct grid *, u_int, u_int, u_int, u_int, u_int);
 void	 grid_clear_lines(struct grid *, u_int, u_int, u_int);
@@ -2609,6 +2692,8 @@ void	 screen_write_clearhistory(struct screen_write_ctx *);
 void	 screen_write_collect_end(struct screen_write_ctx *);
 void	 screen_write_collect_add(struct screen_write_ctx *,
 	     const struct grid_cell *);
+void	 screen_write_collect_add_ascii(struct screen_write_ctx *,
+	     const struct grid_cell *, const u_char *, size_t);
 void	 screen_write_cell(struct screen_write_ctx *, const struct grid_cell *);
 void	 screen_write_setselection(struct screen_write_ctx *, u_char *, u_int);
 void	 screen_write_rawstring(struct screen_write_ctx *, u_char *, u_int);
@@ -2619,7 +2704,7 @@ void	 screen_write_alternateoff(struct screen_write_ctx *,
 
 /* screen-redraw.c */
 void	 screen_redraw_screen(struct client *);
-void	 screen_redraw_pane(struct client *, struct window_pane *);
+void	 screen_redraw_pane(struct client *, struct window_pane *, int);
 
 /* screen.c */
 void	 screen_init(struct screen *, u_int, u_int, u_int);
@@ -2703,6 +2788,7 @@ struct window_pane *window_pane_find_by_id_str(const char *);
 struct window_pane *window_pane_find_by_id(u_int);
 int		 window_pane_destroy_ready(struct window_pane *);
 void		 window_pane_resize(struct window_pane *, u_int, u_int);
+void		 window_pane_redraw_lines(struct window_pane *, u_int, u_int);
 void		 window_pane_set_palette(struct window_pane *, u_int, int);
 void		 window_pane_unset_palette(struct window_pane *, u_int);
 void		 window_pane_reset_palette(struct window_pane *);
@@ -2734,6 +2820,11 @@ void		*window_pane_get_new_data(struct window_pane *,
 		     struct window_pane_offset *, size_t *);
 void		 window_pane_update_used_data(struct window_pane *,
 		     struct window_pane_offset *, size_t);
+struct window_pane_chunk *window_pane_add_chunk(struct window_pane *, size_t,
+		     size_t);
+void		 window_pane_release_chunk(struct window_pane_chunk *);
+char		*window_pane_get_name(struct window_pane *);
+const char	*window_pane_get_cwd(struct window_pane *);
 
 /* layout.c */
 u_int		 layout_count_cells(struct layout_cell *);
@@ -2840,6 +2931,7 @@ void		 window_copy_pageup(struct window_pane *, int);
 void		 window_copy_start_drag(struct client *, struct mouse_event *);
 char		*window_copy_get_word(struct window_pane *, u_int, u_int);
 char		*window_copy_get_line(struct window_pane *, u_int);
+void		 window_copy_free_regex(struct window_copy_regex *);
 
 /* window-option.c */
 extern const struct window_mode window_customize_mode;
@@ -2857,6 +2949,9 @@ void	control_set_pane_on(struct client *, struct window_pane *);
 void	control_set_pane_off(struct client *, struct window_pane *);
 void	control_continue_pane(struct client *, struct window_pane *);
 void	control_pause_pane(struct client *, struct window_pane *);
+void	control_set_pane_screen(struct client *, struct window_pane *);
+void	control_set_pane_rate(struct client *, struct window_pane *, size_t);
+void	control_get_flow(struct client *, size_t *, size_t *, u_int *);
 struct window_pane_offset *control_pane_offset(struct client *,
 	   struct window_pane *, int *);
 void	control_reset_offsets(struct client *);
@@ -2918,9 +3013,17 @@ u_int		 session_group_count(struct session_group *);
 u_int		 session_group_attached_count(struct session_group *);
 void		 session_renumber_windows(struct session *);
 
+/* utf8-width.c */
+extern const char utf8_width_version[];
+u_int		 utf8_width_lookup(u_int);
+
 /* utf8.c */
 utf8_char	 utf8_build_one(u_char);
 enum utf8_state	 utf8_from_data(const struct utf8_data *, utf8_char *);
+int		 utf8_in_table(utf8_char);
+void		 utf8_add_ref(utf8_char);
+void		 utf8_remove_ref(utf8_char);
+void		 utf8_set_ambiguous_width(u_int);
 void		 utf8_to_data(utf8_char, struct utf8_data *);
 void		 utf8_set(struct utf8_data *, u_char);
 void		 utf8_copy(struct utf8_data *, const struct utf8_data *);
@@ -2945,12 +3048,22 @@ char		*osdep_get_cwd(int);
 struct event_base *osdep_event_init(void);
 
 /* log.c */
+extern int log_enabled;
+#ifdef NO_DEBUG_LOG
+#define log_debug_enabled() (0)
+#else
+#define log_debug_enabled() (log_enabled)
+#endif
+#define log_debug(...) do {			\
+	if (log_debug_enabled())		\
+		log_write(__VA_ARGS__);		\
+} while (0)
 void	log_add_level(void);
 int	log_get_level(void);
 void	log_open(const char *);
 void	log_toggle(const char *);
 void	log_close(void);
-void printflike(1, 2) log_debug(const char *, ...);
+void printflike(1, 2) log_write(const char *, ...);
 __dead void printflike(1, 2) fatal(const char *, ...);
 __dead void printflike(1, 2) fatalx(const char *, ...);
 
@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+
+# Generate utf8-width.c, the table of Unicode character widths, from the
+# Unicode database built into Python. Run from the top of the source tree:
+#
+#	python3 tools/utf8-width.py >utf8-width.c
+#
+# Widths are 0 for combining and format characters, 2 for East Asian wide and
+# fullwidth characters, 3 for East Asian ambiguous characters (which are
+# treated as the ambiguous-width option says) and 1 for everything else.
+
+import sys
+import unicodedata
+
+BLOCK = 256
+LAST = 0x110000
+
+# Prepended concatenation marks are format characters but are visible.
+PREPENDED = set(range(0x600, 0x606)) | {
+    0x6dd, 0x70f, 0x890, 0x891, 0x8e2, 0x110bd, 0x110cd
+}
+
+# Hangul Jamo medial vowels and final consonants join to the syllable before.
+JAMO = [(0x1160, 0x11ff), (0xd7b0, 0xd7c6), (0xd7cb, 0xd7fb)]
+
+# Wide whatever the East Asian width: CJK ideographs including unassigned code
+# points in their blocks, circled numbers on black squares and the Yijing
+# hexagrams which are shown with the ideographs.
+WIDE = [
+    (0x3248, 0x324f), (0x3400, 0x4dbf), (0x4dc0, 0x4dff), (0x4e00, 0x9fff),
+    (0xf900, 0xfaff), (0x20000, 0x2fffd), (0x30000, 0x3fffd)
+]
+
+
+def within(cp, ranges):
+    return any(first <= cp <= last for first, last in ranges)
+
+
+def width(cp):
+    c = chr(cp)
+    category = unicodedata.category(c)
+    if cp == 0xad or cp in PREPENDED:
+        return 1
+    if category in ('Mn', 'Me', 'Cf'):
+        return 0
+    if within(cp, JAMO):
+        return 0
+    if within(cp, WIDE):
+        return 2
+    if category == 'Cn':
+        return 1
+    eaw = unicodedata.east_asian_width(c)
+    if eaw in ('W', 'F'):
+        return 2
+    if eaw == 'A':
+        return 3
+    return 1
+
+
+blocks = []
+index = []
+for start in range(0, LAST, BLOCK):
+    packed = bytearray(BLOCK // 4)
+    for cp in range(start, start + BLOCK):
+        offset = cp - start
+        packed[offset // 4] |= width(cp) << ((offset % 4) * 2)
+    packed = bytes(packed)
+    if packed not in blocks:
+        blocks.append(packed)
+    index.append(blocks.index(packed))
+if len(blocks) > 256:
+    sys.exit('too many blocks: %d' % len(blocks))
+
+out = sys.stdout
+out.write('''/* $OpenBSD$ */
+
+/*
+ * Copyright (c) 2026 The tmux authors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Unicode character widths. This file is generated by tools/utf8-width.py
+ * from the Unicode %s database, do not edit.
+ *
+ * Each block of %u code points has two bits per code point: 0, 1 or 2 for
+ * the width or 3 for an East Asian ambiguous character. Identical blocks are
+ * only stored once.
+ */
+
+#include <sys/types.h>
+
+#include "tmux.h"
+
+/* Unicode version of the table. */
+const char utf8_width_version[] = "%s";
+
+static const u_char utf8_width_index[%u] = {
+''' % (unicodedata.unidata_version, BLOCK, unicodedata.unidata_version,
+       len(index)))
+for i in range(0, len(index), 16):
+    out.write('\t' + ', '.join('%u' % x for x in index[i:i + 16]) + ',\n')
+out.write('''};
+
+static const u_char utf8_width_blocks[%u][%u] = {
+''' % (len(blocks), BLOCK // 4))
+for packed in blocks:
+    out.write('\t{\n')
+    for i in range(0, len(packed), 8):
+        out.write('\t\t' +
+                  ', '.join('0x%02x' % x for x in packed[i:i + 8]) + ',\n')
+    out.write('\t},\n')
+out.write('''};
+
+/* Look up the width of a code point, 3 if it is ambiguous. */
+u_int
+utf8_width_lookup(u_int cp)
+{
+	const u_char	*block;
+
+	if (cp >= %u)
+		return (1);
+	block = utf8_width_blocks[utf8_width_index[cp / %u]];
+	return ((block[(cp %% %u) / 4] >> ((cp %% 4) * 2)) & 3);
+}
+''' % (LAST, BLOCK, BLOCK))
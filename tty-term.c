@@ -31,6 +31,7 @@
 #include "tmux.h"
 
 static char	*tty_term_strip(const char *);
+static void	 tty_term_compile(struct tty_code *);
 
 struct tty_terms tty_terms = LIST_HEAD_INITIALIZER(tty_terms);
 
@@ -41,6 +42,35 @@ enum tty_code_type {
 	TTYCODE_FLAG,
 };
 
+/*
+ * String capabilities are compiled into a list of operations when they are
+ * loaded so they can be expanded without going through tparm(3) each time.
+ * Only the subset of terminfo(5) % sequences used by common terminals is
+ * supported; anything else leaves ops as NULL and tparm(3) is used instead.
+ */
+enum tty_code_op_type {
+	TTYOP_STRING,
+	TTYOP_PARAMETER,
+	TTYOP_CONSTANT,
+	TTYOP_INCREMENT,
+	TTYOP_PRINT,
+	TTYOP_UNARY,
+	TTYOP_BINARY,
+	TTYOP_BRANCH,
+	TTYOP_JUMP,
+};
+
+struct tty_code_op {
+	enum tty_code_op_type	type;
+	int			value;
+	size_t			size;
+};
+
+/* Maximum expanded size, stack and conditional depth of a compiled string. */
+#define TTY_CODE_SIZE 256
+#define TTY_CODE_STACK 16
+#define TTY_CODE_DEPTH 8
+
 struct tty_code {
 	enum tty_code_type	type;
 	union {
@@ -48,6 +78,10 @@ struct tty_code {
 		int		number;
 		int		flag;
 	} value;
+
+	size_t			length;
+	struct tty_code_op     *ops;
+	u_int			nops;
 };
 
 struct tty_term_code_entry {
@@ -316,6 +350,282 @@ tty_term_strip(const char *s)
 	return (xstrdup(buf));
 }
 
+/* Add an operation to a compiled string. */
+static void
+tty_term_compile_add(struct tty_code *code, enum tty_code_op_type type,
+    int value, size_t size)
+{
+	struct tty_code_op	*op;
+
+	code->ops = xreallocarray(code->ops, code->nops + 1, sizeof *code->ops);
+	op = &code->ops[code->nops++];
+	op->type = type;
+	op->value = value;
+	op->size = size;
+}
+
+/* Point unresolved branches (and jumps if wanted) after start at the end. */
+static void
+tty_term_compile_patch(struct tty_code *code, u_int start, int jumps)
+{
+	struct tty_code_op	*op;
+	u_int			 i;
+
+	for (i = start; i < code->nops; i++) {
+		op = &code->ops[i];
+		if (op->value != -1)
+			continue;
+		if (op->type == TTYOP_BRANCH ||
+		    (jumps && op->type == TTYOP_JUMP))
+			op->value = code->nops;
+	}
+}
+
+/* Compile a string capability. */
+static void
+tty_term_compile(struct tty_code *code)
+{
+	const char	*string = code->value.string, *s, *end;
+	u_int		 open[TTY_CODE_DEPTH], depth = 0;
+	size_t		 size = 0;
+	int		 n, parameters = 0;
+
+	free(code->ops);
+	code->ops = NULL;
+	code->nops = 0;
+	code->length = strlen(string);
+
+	for (s = string; *s != '\0'; s++) {
+		if (*s != '%') {
+			end = strchr(s, '%');
+			if (end == NULL)
+				end = string + code->length;
+			tty_term_compile_add(code, TTYOP_STRING, s - string,
+			    end - s);
+			size += end - s;
+			s = end - 1;
+			continue;
+		}
+		switch (*++s) {
+		case '%':
+			tty_term_compile_add(code, TTYOP_STRING, s - string, 1);
+			size++;
+			break;
+		case 'p':
+			if (s[1] < '1' || s[1] > '9')
+				goto fail;
+			tty_term_compile_add(code, TTYOP_PARAMETER, *++s - '1',
+			    0);
+			parameters = 1;
+			break;
+		case '{':
+			n = 0;
+			for (s++; *s >= '0' && *s <= '9'; s++) {
+				if (n > (INT_MAX - 9) / 10)
+					goto fail;
+				n = (n * 10) + (*s - '0');
+			}
+			if (*s != '}')
+				goto fail;
+			tty_term_compile_add(code, TTYOP_CONSTANT, n, 0);
+			break;
+		case '\'':
+			if (s[1] == '\0' || s[2] != '\'')
+				goto fail;
+			tty_term_compile_add(code, TTYOP_CONSTANT,
+			    (u_char)s[1], 0);
+			s += 2;
+			break;
+		case 'i':
+			tty_term_compile_add(code, TTYOP_INCREMENT, 0, 0);
+			break;
+		case 'd':
+			/*
+			 * Without any %p, tparm(3) pushes the parameters
+			 * itself termcap-style, so leave those strings to it.
+			 */
+			if (!parameters)
+				goto fail;
+			tty_term_compile_add(code, TTYOP_PRINT, 0, 0);
+			size += 11;
+			break;
+		case '!':
+		case '~':
+			tty_term_compile_add(code, TTYOP_UNARY, *s, 0);
+			break;
+		case '+':
+		case '-':
+		case '*':
+		case '/':
+		case 'm':
+		case '&':
+		case '|':
+		case '^':
+		case '=':
+		case '<':
+		case '>':
+		case 'A':
+		case 'O':
+			tty_term_compile_add(code, TTYOP_BINARY, *s, 0);
+			break;
+		case '?':
+			if (depth == TTY_CODE_DEPTH)
+				goto fail;
+			open[depth++] = code->nops;
+			break;
+		case 't':
+			if (depth == 0)
+				goto fail;
+			tty_term_compile_add(code, TTYOP_BRANCH, -1, 0);
+			break;
+		case 'e':
+			if (depth == 0)
+				goto fail;
+			tty_term_compile_add(code, TTYOP_JUMP, -1, 0);
+			tty_term_compile_patch(code, open[depth - 1], 0);
+			break;
+		case ';':
+			if (depth == 0)
+				goto fail;
+			tty_term_compile_patch(code, open[--depth], 1);
+			break;
+		default:
+			goto fail;
+		}
+	}
+	if (depth == 0 && size < TTY_CODE_SIZE)
+		return;
+
+fail:
+	free(code->ops);
+	code->ops = NULL;
+	code->nops = 0;
+}
+
+/* Expand a compiled string capability. */
+static const char *
+tty_term_expand(struct tty_code *code, int a, int b, int c, size_t *length)
+{
+	static char		 buf[TTY_CODE_SIZE];
+	struct tty_code_op	*op;
+	int			 parameters[3] = { a, b, c };
+	int			 stack[TTY_CODE_STACK], x, y;
+	u_int			 i, depth = 0;
+	size_t			 size = 0;
+	char			 digits[11];
+	u_int			 n;
+
+	/* A fixed string can be used as it is. */
+	if (code->nops == 1 && code->ops[0].type == TTYOP_STRING) {
+		*length = code->length;
+		return (code->value.string);
+	}
+
+#define TTY_CODE_POP() (depth == 0 ? 0 : stack[--depth])
+#define TTY_CODE_PUSH(v) do {						\
+	if (depth != TTY_CODE_STACK)					\
+		stack[depth++] = (v);					\
+} while (0)
+	for (i = 0; i < code->nops; i++) {
+		op = &code->ops[i];
+		switch (op->type) {
+		case TTYOP_STRING:
+			memcpy(buf + size, code->value.string + op->value,
+			    op->size);
+			size += op->size;
+			break;
+		case TTYOP_PARAMETER:
+			if (op->value < 3)
+				TTY_CODE_PUSH(parameters[op->value]);
+			else
+				TTY_CODE_PUSH(0);
+			break;
+		case TTYOP_CONSTANT:
+			TTY_CODE_PUSH(op->value);
+			break;
+		case TTYOP_INCREMENT:
+			parameters[0]++;
+			parameters[1]++;
+			break;
+		case TTYOP_PRINT:
+			x = TTY_CODE_POP();
+			if (x < 0)
+				buf[size++] = '-';
+			n = (x < 0) ? -(u_int)x : (u_int)x;
+			y = 0;
+			do
+				digits[y++] = '0' + (n % 10);
+			while ((n /= 10) != 0);
+			while (y != 0)
+				buf[size++] = digits[--y];
+			break;
+		case TTYOP_UNARY:
+			x = TTY_CODE_POP();
+			TTY_CODE_PUSH(op->value == '!' ? !x : ~x);
+			break;
+		case TTYOP_BINARY:
+			y = TTY_CODE_POP();
+			x = TTY_CODE_POP();
+			switch (op->value) {
+			case '+':
+				x += y;
+				break;
+			case '-':
+				x -= y;
+				break;
+			case '*':
+				x *= y;
+				break;
+			case '/':
+				x = (y != 0) ? x / y : 0;
+				break;
+			case 'm':
+				x = (y != 0) ? x % y : 0;
+				break;
+			case '&':
+				x &= y;
+				break;
+			case '|':
+				x |= y;
+				break;
+			case '^':
+				x ^= y;
+				break;
+			case '=':
+				x = (x == y);
+				break;
+			case '<':
+				x = (x < y);
+				break;
+			case '>':
+				x = (x > y);
+				break;
+			case 'A':
+				x = (x && y);
+				break;
+			case 'O':
+				x = (x || y);
+				break;
+			}
+			TTY_CODE_PUSH(x);
+			break;
+		case TTYOP_BRANCH:
+			if (TTY_CODE_POP() == 0)
+				i = op->value - 1;
+			break;
+		case TTYOP_JUMP:
+			i = op->value - 1;
+			break;
+		}
+	}
+#undef TTY_CODE_POP
+#undef TTY_CODE_PUSH
+	buf[size] = '\0';
+
+	*length = size;
+	return (buf);
+}
+
 static char *
 tty_term_override_next(const char *s, size_t *offset)
 {
@@ -393,6 +703,9 @@ tty_term_apply(struct tty_term *term, const char *capabilities, int quiet)
 			code = &term->codes[i];
 
 			if (remove) {
+				free(code->ops);
+				code->ops = NULL;
+				code->nops = 0;
 				code->type = TTYCODE_NONE;
 				continue;
 			}
@@ -404,6 +717,7 @@ tty_term_apply(struct tty_term *term, const char *capabilities, int quiet)
 					free(code->value.string);
 				code->value.string = xstrdup(value);
 				code->type = ent->type;
+				tty_term_compile(code);
 				break;
 			case TTYCODE_NUMBER:
 				n = strtonum(value, 0, INT_MAX, &errstr);
@@ -506,6 +820,7 @@ tty_term_create(struct tty *tty, char *name, int *feat, int fd, char **cause)
 				break;
 			code->type = TTYCODE_STRING;
 			code->value.string = tty_term_strip(s);
+			tty_term_compile(code);
 			break;
 		case TTYCODE_NUMBER:
 			n = tigetnum((char *) ent->name);
@@ -633,6 +948,7 @@ tty_term_free(struct tty_term *term)
 	for (i = 0; i < tty_term_ncodes(); i++) {
 		if (term->codes[i].type == TTYCODE_STRING)
 			free(term->codes[i].value.string);
+		free(term->codes[i].ops);
 	}
 	free(term->codes);
 
@@ -657,23 +973,54 @@ tty_term_string(struct tty_term *term, enum tty_code_code code)
 	return (term->codes[code].value.string);
 }
 
+size_t
+tty_term_length(struct tty_term *term, enum tty_code_code code)
+{
+	if (!tty_term_has(term, code))
+		return (0);
+	if (term->codes[code].type != TTYCODE_STRING)
+		fatalx("not a string: %d", code);
+	return (term->codes[code].length);
+}
+
+/* Expand a string with parameters, returning its length if wanted. */
+const char *
+tty_term_format(struct tty_term *term, enum tty_code_code code, int a, int b,
+    int c, size_t *length)
+{
+	struct tty_code	*tc = &term->codes[code];
+	const char	*s;
+	size_t		 size;
+
+	if (tc->type == TTYCODE_STRING && tc->ops != NULL) {
+		s = tty_term_expand(tc, a, b, c, &size);
+		if (length != NULL)
+			*length = size;
+		return (s);
+	}
+	s = tparm((char *) tty_term_string(term, code), a, b, c, 0, 0, 0, 0, 0, 0);
+	if (length != NULL)
+		*length = strlen(s);
+	return (s);
+}
+
 const char *
 tty_term_string1(struct tty_term *term, enum tty_code_code code, int a)
 {
-	return (tparm((char *) tty_term_string(term, code), a, 0, 0, 0, 0, 0, 0, 0, 0));
+	return (tty_term_format(term, code, a, 0, 0, NULL));
 }
 
 const char *
 tty_term_string2(struct tty_term *term, enum tty_code_code code, int a, int b)
 {
-	return (tparm((char *) tty_term_string(term, code), a, b, 0, 0, 0, 0, 0, 0, 0));
+	return (tty_term_format(term, code, a, b, 0, NULL));
 }
 
 const char *
 tty_term_string3(struct tty_term *term, enum tty_code_code code, int a, int b,
     int c)
 {
-	return (tparm((char *) tty_term_string(term, code), a, b, c, 0, 0, 0, 0, 0, 0));
+	return (tty_term_format(term, code, a, b, c, NULL));
 }
 
 const char *
@@ -33,6 +33,7 @@
 #include "tmux.h"
 
 static int	tty_log_fd = -1;
+static struct tty_share *tty_sharing;
 
 static int	tty_client_ready(struct client *);
 
@@ -44,6 +45,7 @@ static void	tty_cursor_pane(struct tty *, const struct tty_ctx *, u_int,
 static void	tty_cursor_pane_unless_wrap(struct tty *,
 		    const struct tty_ctx *, u_int, u_int);
 static void	tty_invalidate(struct tty *);
+static void	tty_add(struct tty *, const char *, size_t);
 static void	tty_colours(struct tty *, const struct grid_cell *);
 static void	tty_check_fg(struct tty *, int *, struct grid_cell *);
 static void	tty_check_bg(struct tty *, int *, struct grid_cell *);
@@ -67,6 +69,14 @@ static void	tty_repeat_space(struct tty *, u_int);
 static void	tty_draw_pane(struct tty *, const struct tty_ctx *, u_int);
 static void	tty_default_attributes(struct tty *, const struct grid_cell *,
 		    int *, u_int);
+static void	tty_check_reverse(struct tty *, struct grid_cell *);
+
+static void	tty_shadow_free(struct tty *);
+static void	tty_shadow_invalidate(struct tty *, u_int, u_int, u_int);
+static void	tty_shadow_invalidate_lines(struct tty *, u_int, u_int);
+static void	tty_shadow_invalidate_region(struct tty *);
+static void	tty_shadow_print(struct tty *, u_int);
+static void	tty_shadow_code(struct tty *, enum tty_code_code, u_int);
 
 #define tty_use_margin(tty) \
 	(tty->term->flags & TERM_DECSLRM)
@@ -77,6 +87,65 @@ static void	tty_default_attributes(struct tty *, const struct grid_cell *,
 #define TTY_BLOCK_START(tty) (1 + ((tty)->sx * (tty)->sy) * 8)
 #define TTY_BLOCK_STOP(tty) (1 + ((tty)->sx * (tty)->sy) / 8)
 
+#define TTY_SHADOW_RUN 8
+
+#define TTY_SHARE_MAX 8
+#define TTY_SHARE_FLAGS (TTY_NOCURSOR|TTY_SYNCING)
+
+/* Cell in the shadow of the terminal. */
+struct tty_shadow_cell {
+	u_char		data[4];
+	u_char		size; /* 0 if too big to keep */
+	u_char		width; /* 0 if not known */
+
+	u_short		attr;
+	int		fg;
+	int		bg;
+	int		us;
+};
+
+/* Copy of what has been drawn on the terminal. */
+struct tty_shadow {
+	u_int			 sx;
+	u_int			 sy;
+
+	u_char			*lines; /* 0 if nothing on the line is known */
+	struct tty_shadow_cell	*cells;
+};
+
+/* State of a terminal which affects what is written to it. */
+struct tty_state {
+	u_int			 cx;
+	u_int			 cy;
+	u_int			 cstyle;
+	char			 ccolour[32];
+	int			 mode;
+
+	u_int			 rlower;
+	u_int			 rupper;
+	u_int			 rleft;
+	u_int			 rright;
+
+	struct grid_cell	 cell;
+	struct grid_cell	 last_cell;
+
+	int			 flags;
+};
+
+/*
+ * Output written to one terminal by a command, which can be copied to other
+ * terminals of the same type and size, in the same state.
+ */
+struct tty_share {
+	struct tty		*tty;
+	struct tty_ctx		 ctx;
+
+	struct tty_state	 before;
+	struct tty_state	 after;
+
+	struct evbuffer		*out;
+};
+
 void
 tty_create_log(void)
 {
@@ -445,6 +514,7 @@ void
 tty_free(struct tty *tty)
 {
 	tty_close(tty);
+	tty_shadow_free(tty);
 	free(tty->ccolour);
 }
 
@@ -485,36 +555,57 @@ tty_raw(struct tty *tty, const char *s)
 			break;
 		usleep(100);
 	}
+	tty_shadow_invalidate_all(tty);
 }
 
 void
 tty_putcode(struct tty *tty, enum tty_code_code code)
 {
-	tty_puts(tty, tty_term_string(tty->term, code));
+	size_t	len;
+
+	tty_shadow_code(tty, code, 1);
+	if ((len = tty_term_length(tty->term, code)) != 0)
+		tty_add(tty, tty_term_string(tty->term, code), len);
 }
 
 void
 tty_putcode1(struct tty *tty, enum tty_code_code code, int a)
 {
+	const char	*s;
+	size_t		 len;
+
 	if (a < 0)
 		return;
-	tty_puts(tty, tty_term_string1(tty->term, code, a));
+	tty_shadow_code(tty, code, a);
+	s = tty_term_format(tty->term, code, a, 0, 0, &len);
+	if (len != 0)
+		tty_add(tty, s, len);
 }
 
 void
 tty_putcode2(struct tty *tty, enum tty_code_code code, int a, int b)
 {
+	const char	*s;
+	size_t		 len;
+
 	if (a < 0 || b < 0)
 		return;
-	tty_puts(tty, tty_term_string2(tty->term, code, a, b));
+	s = tty_term_format(tty->term, code, a, b, 0, &len);
+	if (len != 0)
+		tty_add(tty, s, len);
 }
 
 void
 tty_putcode3(struct tty *tty, enum tty_code_code code, int a, int b, int c)
 {
+	const char	*s;
+	size_t		 len;
+
 	if (a < 0 || b < 0 || c < 0)
 		return;
-	tty_puts(tty, tty_term_string3(tty->term, code, a, b, c));
+	s = tty_term_format(tty->term, code, a, b, c, &len);
+	if (len != 0)
+		tty_add(tty, s, len);
 }
 
 void
@@ -539,12 +630,15 @@ tty_add(struct tty *tty, const char *buf, size_t len)
 
 	if (tty->flags & TTY_BLOCK) {
 		tty->discarded += len;
+		tty_shadow_invalidate_all(tty);
 		return;
 	}
 
 	evbuffer_add(tty->out, buf, len);
 	log_debug("%s: %.*s", c->name, (int)len, buf);
 	c->written += len;
+	if (tty_sharing != NULL && tty_sharing->tty == tty)
+		evbuffer_add(tty_sharing->out, buf, len);
 
 	if (tty_log_fd != -1)
 		write(tty_log_fd, buf, len);
@@ -580,6 +674,7 @@ tty_putc(struct tty *tty, u_char ch)
 		tty_add(tty, &ch, 1);
 
 	if (ch >= 0x20 && ch != 0x7f) {
+		tty_shadow_print(tty, 1);
 		if (tty->cx >= tty->sx) {
 			tty->cx = 1;
 			if (tty->cy != tty->rlower)
@@ -594,7 +689,9 @@ tty_putc(struct tty *tty, u_char ch)
 				tty_putcode2(tty, TTYC_CUP, tty->cy, tty->cx);
 		} else
 			tty->cx++;
-	}
+	} else if (ch == '\n' &&
+	    (tty->cy == UINT_MAX || tty->cy == tty->rlower))
+		tty_shadow_invalidate_region(tty);
 }
 
 void
@@ -605,6 +702,7 @@ tty_putn(struct tty *tty, const void *buf, size_t len, u_int width)
 	    tty->cx + len >= tty->sx)
 		len = tty->sx - tty->cx - 1;
 
+	tty_shadow_print(tty, width);
 	tty_add(tty, buf, len);
 	if (tty->cx + width > tty->sx) {
 		tty->cx = (tty->cx + width) - tty->sx;
@@ -755,6 +853,283 @@ tty_repeat_space(struct tty *tty, u_int n)
 		tty_putn(tty, s, n, n);
 }
 
+/* Create or free the shadow of the terminal depending on the option. */
+static void
+tty_shadow_update(struct tty *tty)
+{
+	struct tty_shadow	*ts = tty->shadow;
+
+	if (!options_get_number(global_options, "terminal-shadow") ||
+	    tty->sx == 0 ||
+	    tty->sy == 0) {
+		tty_shadow_free(tty);
+		return;
+	}
+	if (ts != NULL && ts->sx == tty->sx && ts->sy == tty->sy)
+		return;
+	tty_shadow_free(tty);
+
+	ts = tty->shadow = xcalloc(1, sizeof *ts);
+	ts->sx = tty->sx;
+	ts->sy = tty->sy;
+	ts->lines = xcalloc(ts->sy, sizeof *ts->lines);
+	ts->cells = xreallocarray(NULL, (size_t)ts->sx * ts->sy,
+	    sizeof *ts->cells);
+}
+
+/* Free the shadow of the terminal. */
+static void
+tty_shadow_free(struct tty *tty)
+{
+	struct tty_shadow	*ts = tty->shadow;
+
+	if (ts == NULL)
+		return;
+	free(ts->lines);
+	free(ts->cells);
+	free(ts);
+	tty->shadow = NULL;
+}
+
+/* Forget some cells on a line. */
+static void
+tty_shadow_invalidate(struct tty *tty, u_int px, u_int py, u_int nx)
+{
+	struct tty_shadow	*ts = tty->shadow;
+	struct tty_shadow_cell	*line;
+	u_int			 i;
+
+	if (ts == NULL || py >= ts->sy || px >= ts->sx || !ts->lines[py])
+		return;
+	if (nx > ts->sx - px)
+		nx = ts->sx - px;
+	line = &ts->cells[(size_t)py * ts->sx];
+
+	/* Overwriting half of a wide character removes all of it. */
+	if (px != 0 && line[px - 1].width > 1)
+		line[px - 1].width = 0;
+	for (i = px; i < px + nx; i++)
+		line[i].width = 0;
+}
+
+/* Forget some lines. */
+static void
+tty_shadow_invalidate_lines(struct tty *tty, u_int py, u_int ny)
+{
+	struct tty_shadow	*ts = tty->shadow;
+
+	if (ts == NULL || py >= ts->sy)
+		return;
+	if (ny > ts->sy - py)
+		ny = ts->sy - py;
+	memset(ts->lines + py, 0, ny);
+}
+
+/* Forget everything. */
+void
+tty_shadow_invalidate_all(struct tty *tty)
+{
+	if (tty->shadow != NULL)
+		memset(tty->shadow->lines, 0, tty->shadow->sy);
+}
+
+/* Forget the scroll region, or everything if it is not known. */
+static void
+tty_shadow_invalidate_region(struct tty *tty)
+{
+	if (tty->rupper == UINT_MAX ||
+	    tty->rlower == UINT_MAX ||
+	    tty->rupper > tty->rlower)
+		tty_shadow_invalidate_all(tty);
+	else {
+		tty_shadow_invalidate_lines(tty, tty->rupper,
+		    tty->rlower - tty->rupper + 1);
+	}
+}
+
+/* Forget cells about to be overwritten by printing at the cursor. */
+static void
+tty_shadow_print(struct tty *tty, u_int width)
+{
+	u_int	cx = tty->cx, cy = tty->cy;
+
+	if (tty->shadow == NULL || (tty->flags & TTY_SHADOWSET))
+		return;
+	if (cx == UINT_MAX || cy == UINT_MAX) {
+		tty_shadow_invalidate_all(tty);
+		return;
+	}
+	if (cx + width <= tty->sx) {
+		tty_shadow_invalidate(tty, cx, cy, width);
+		return;
+	}
+
+	/* This will wrap and possibly scroll. */
+	if (tty->rlower == UINT_MAX || cy >= tty->rlower)
+		tty_shadow_invalidate_region(tty);
+	tty_shadow_invalidate_lines(tty, cy, 2 + width / tty->sx);
+}
+
+/* Forget cells about to be changed by a terminal code. */
+static void
+tty_shadow_code(struct tty *tty, enum tty_code_code code, u_int n)
+{
+	u_int	cx = tty->cx, cy = tty->cy;
+
+	if (tty->shadow == NULL || (tty->flags & TTY_SHADOWSET))
+		return;
+
+	switch (code) {
+	case TTYC_CLEAR:
+	case TTYC_SMCUP:
+	case TTYC_RMCUP:
+		tty_shadow_invalidate_all(tty);
+		return;
+	case TTYC_INDN:
+	case TTYC_RI:
+	case TTYC_RIN:
+		tty_shadow_invalidate_region(tty);
+		return;
+	case TTYC_DCH:
+	case TTYC_DCH1:
+	case TTYC_DL:
+	case TTYC_DL1:
+	case TTYC_ECH:
+	case TTYC_ED:
+	case TTYC_EL:
+	case TTYC_EL1:
+	case TTYC_ICH:
+	case TTYC_ICH1:
+	case TTYC_IL:
+	case TTYC_IL1:
+		break;
+	default:
+		return;
+	}
+
+	if (cx == UINT_MAX || cy == UINT_MAX) {
+		tty_shadow_invalidate_all(tty);
+		return;
+	}
+	if (cx >= tty->sx)
+		cx = tty->sx - 1;
+	switch (code) {
+	case TTYC_ECH:
+		tty_shadow_invalidate(tty, cx, cy, n);
+		break;
+	case TTYC_EL1:
+		tty_shadow_invalidate(tty, 0, cy, cx + 1);
+		break;
+	case TTYC_DCH:
+	case TTYC_DCH1:
+	case TTYC_EL:
+	case TTYC_ICH:
+	case TTYC_ICH1:
+		tty_shadow_invalidate(tty, cx, cy, tty->sx - cx);
+		break;
+	default:
+		tty_shadow_invalidate_lines(tty, cy, tty->sy - cy);
+		break;
+	}
+}
+
+/* Work out how a cell will appear on the terminal. */
+static void
+tty_shadow_resolve(struct tty *tty, const struct grid_cell *gc,
+    const struct grid_cell *defaults, int *palette,
+    struct tty_shadow_cell *tsc)
+{
+	struct grid_cell	gc2;
+
+	memcpy(&gc2, gc, sizeof gc2);
+	if (gc2.fg == 8)
+		gc2.fg = defaults->fg;
+	if (gc2.bg == 8)
+		gc2.bg = defaults->bg;
+	tty_check_reverse(tty, &gc2);
+	tty_check_fg(tty, palette, &gc2);
+	tty_check_bg(tty, palette, &gc2);
+	tty_check_us(tty, palette, &gc2);
+
+	memset(tsc, 0, sizeof *tsc);
+	if (gc2.data.size <= sizeof tsc->data) {
+		memcpy(tsc->data, gc2.data.data, gc2.data.size);
+		tsc->size = gc2.data.size;
+	}
+	tsc->width = gc2.data.width;
+	tsc->attr = gc2.attr;
+	tsc->fg = gc2.fg;
+	tsc->bg = gc2.bg;
+	tsc->us = gc2.us;
+}
+
+/* Check if the terminal already has a cell repeated nx times. */
+static int
+tty_shadow_same(struct tty *tty, u_int px, u_int py, u_int nx,
+    const struct tty_shadow_cell *tsc)
+{
+	struct tty_shadow	*ts = tty->shadow;
+	struct tty_shadow_cell	*line, *c;
+	u_int			 i;
+
+	if (ts == NULL || tsc->size == 0 || tsc->width == 0)
+		return (0);
+	if (py >= ts->sy || !ts->lines[py])
+		return (0);
+	if (px >= ts->sx || nx > (ts->sx - px) / tsc->width)
+		return (0);
+	line = &ts->cells[(size_t)py * ts->sx];
+
+	for (i = 0; i < nx; i++) {
+		c = &line[px + i * tsc->width];
+		if (c->width != tsc->width ||
+		    c->size != tsc->size ||
+		    c->attr != tsc->attr ||
+		    c->fg != tsc->fg ||
+		    c->bg != tsc->bg ||
+		    c->us != tsc->us ||
+		    memcmp(c->data, tsc->data, tsc->size) != 0)
+			return (0);
+	}
+	return (1);
+}
+
+/* Record a cell repeated nx times as drawn on the terminal. */
+static void
+tty_shadow_set(struct tty *tty, u_int px, u_int py, u_int nx,
+    const struct tty_shadow_cell *tsc)
+{
+	struct tty_shadow	*ts = tty->shadow;
+	struct tty_shadow_cell	*line;
+	u_int			 i, width;
+
+	if (ts == NULL || py >= ts->sy || px >= ts->sx)
+		return;
+	width = tsc->width;
+	if (width == 0) {
+		tty_shadow_invalidate(tty, px, py, nx);
+		return;
+	}
+	tty_shadow_invalidate(tty, px, py, nx * width);
+
+	/* Cells which do not fit or may not be written are left unknown. */
+	if (tsc->size == 0 || nx > (ts->sx - px) / width)
+		return;
+	if ((tty->term->flags & TERM_NOAM) &&
+	    py == ts->sy - 1 &&
+	    px + nx * width == ts->sx)
+		return;
+
+	if (!ts->lines[py]) {
+		line = &ts->cells[(size_t)py * ts->sx];
+		memset(line, 0, ts->sx * sizeof *line);
+		ts->lines[py] = 1;
+	}
+	line = &ts->cells[(size_t)py * ts->sx];
+	for (i = 0; i < nx; i++)
+		memcpy(&line[px + i * width], tsc, sizeof *line);
+}
+
 /* Is this window bigger than the terminal? */
 int
 tty_window_bigger(struct tty *tty)
@@ -1165,6 +1540,7 @@ tty_clear_area(struct tty *tty, const struct grid_cell *defaults, u_int py,
 			xsnprintf(tmp, sizeof tmp, "\033[32;%u;%u;%u;%u$x",
 			    py + 1, px + 1, py + ny, px + nx);
 			tty_puts(tty, tmp);
+			tty_shadow_invalidate_lines(tty, py, ny);
 			return;
 		}
 
@@ -1272,18 +1648,35 @@ tty_check_overlay(struct tty *tty, u_int px, u_int py)
 	return (c->overlay_check(c, px, py));
 }
 
+/* Record cells cleared while drawing a line. */
+static void
+tty_draw_line_cleared(struct tty *tty, const struct grid_cell *gc,
+    const struct grid_cell *defaults, int *palette, u_int px, u_int py,
+    u_int nx)
+{
+	struct tty_shadow_cell	tsc;
+
+	if (tty->shadow != NULL) {
+		tty_shadow_resolve(tty, gc, defaults, palette, &tsc);
+		tty_shadow_set(tty, px, py, nx, &tsc);
+	}
+}
+
 void
 tty_draw_line(struct tty *tty, struct screen *s, u_int px, u_int py, u_int nx,
     u_int atx, u_int aty, const struct grid_cell *defaults, int *palette)
 {
 	struct grid		*gd = s->grid;
-	struct grid_cell	 gc, last;
+	struct grid_cell	 gc, last, sgc;
 	const struct grid_cell	*gcp;
 	struct grid_line	*gl;
+	struct tty_shadow_cell	 tsc;
 	u_int			 i, j, ux, sx, width;
+	u_int			 same = 0, samewidth = 0, skipped = 0;
 	int			 flags, cleared = 0, wrapped = 0;
+	int			 match, skip, skipping = 0;
 	char			 buf[512];
-	size_t			 len;
+	size_t			 len, samelen = 0;
 	u_int			 cellsize;
 
 	log_debug("%s: px=%u py=%u nx=%u atx=%u aty=%u", __func__,
@@ -1301,6 +1694,7 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int px, u_int py, u_int nx,
 
 	tty_region_off(tty);
 	tty_margin_off(tty);
+	tty_shadow_update(tty);
 
 	/*
 	 * Clamp the width to cellsize - note this is not cellused, because
@@ -1327,7 +1721,8 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int px, u_int py, u_int nx,
 	    atx != 0 ||
 	    tty->cx < tty->sx ||
 	    nx < tty->sx) {
-		if (nx < tty->sx &&
+		if (tty->shadow == NULL &&
+		    nx < tty->sx &&
 		    atx == 0 &&
 		    px + sx != nx &&
 		    tty_term_has(tty->term, TTYC_EL1) &&
@@ -1349,8 +1744,47 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int px, u_int py, u_int nx,
 	for (i = 0; i < sx; i++) {
 		grid_view_get_cell(gd, px + i, py, &gc);
 		gcp = tty_check_codeset(tty, &gc);
+
+		/*
+		 * Check if the terminal already has this cell. Wrapped lines
+		 * are started by writing over the end of the previous line,
+		 * so always write the first cell.
+		 */
+		match = 0;
+		if (tty->shadow != NULL && (~gcp->flags & GRID_FLAG_PADDING)) {
+			if (gcp->flags & GRID_FLAG_SELECTED) {
+				screen_select_cell(s, &sgc, gcp);
+				tty_shadow_resolve(tty, &sgc, defaults, palette,
+				    &tsc);
+			} else
+				tty_shadow_resolve(tty, gcp, defaults, palette,
+				    &tsc);
+			if (!wrapped &&
+			    ux + width + gcp->data.width <= nx &&
+			    tty_check_overlay(tty, atx + ux + width, aty) &&
+			    tty_shadow_same(tty, atx + ux + width, aty, 1, &tsc))
+				match = 1;
+			else
+				skipping = 0;
+		}
+
+		/*
+		 * A cell the terminal already has can be skipped if the cursor
+		 * must be moved anyway; otherwise it is only worth skipping
+		 * as part of a long enough run (see below).
+		 */
+		skip = 0;
+		if (match &&
+		    (skipping ||
+		    (len == 0 && (tty->cx != atx + ux || tty->cy != aty)))) {
+			skip = 1;
+			skipping = 1;
+		}
+
 		if (len != 0 &&
-		    (!tty_check_overlay(tty, atx + ux + width, aty) ||
+		    (skip ||
+		    skipped != 0 ||
+		    !tty_check_overlay(tty, atx + ux + width, aty) ||
 		    (gcp->attr & GRID_ATTR_CHARSET) ||
 		    gcp->flags != last.flags ||
 		    gcp->attr != last.attr ||
@@ -1360,21 +1794,30 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int px, u_int py, u_int nx,
 		    ux + width + gcp->data.width > nx ||
 		    (sizeof buf) - len < gcp->data.size)) {
 			tty_attributes(tty, &last, defaults, palette);
+			tty->flags |= TTY_SHADOWSET;
 			if (last.flags & GRID_FLAG_CLEARED) {
 				log_debug("%s: %zu cleared", __func__, len);
 				tty_clear_line(tty, defaults, aty, atx + ux,
 				    width, last.bg);
+				tty_draw_line_cleared(tty, &last, defaults,
+				    palette, atx + ux, aty, width);
 			} else {
 				if (!wrapped || atx != 0 || ux != 0)
 					tty_cursor(tty, atx + ux, aty);
 				tty_putn(tty, buf, len, width);
 			}
+			tty->flags &= ~TTY_SHADOWSET;
 			ux += width;
 
 			len = 0;
 			width = 0;
 			wrapped = 0;
+
+			same = samewidth = 0;
+			samelen = 0;
 		}
+		ux += skipped;
+		skipped = 0;
 
 		if (gcp->flags & GRID_FLAG_SELECTED)
 			screen_select_cell(s, &last, gcp);
@@ -1383,7 +1826,9 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int px, u_int py, u_int nx,
 		if (!tty_check_overlay(tty, atx + ux, aty)) {
 			if (~gcp->flags & GRID_FLAG_PADDING)
 				ux += gcp->data.width;
-		} else if (ux + gcp->data.width > nx) {
+		} else if (skip)
+			ux += gcp->data.width;
+		else if (ux + gcp->data.width > nx) {
 			tty_attributes(tty, &last, defaults, palette);
 			tty_cursor(tty, atx + ux, aty);
 			for (j = 0; j < gcp->data.width; j++) {
@@ -1395,34 +1840,80 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int px, u_int py, u_int nx,
 		} else if (gcp->attr & GRID_ATTR_CHARSET) {
 			tty_attributes(tty, &last, defaults, palette);
 			tty_cursor(tty, atx + ux, aty);
+			tty->flags |= TTY_SHADOWSET;
 			for (j = 0; j < gcp->data.size; j++)
 				tty_putc(tty, gcp->data.data[j]);
+			tty->flags &= ~TTY_SHADOWSET;
+			tty_shadow_set(tty, atx + ux, aty, 1, &tsc);
 			ux += gcp->data.width;
 		} else if (~gcp->flags & GRID_FLAG_PADDING) {
+			/* Cleared cells are recorded when they are drawn. */
+			if (~gcp->flags & GRID_FLAG_CLEARED)
+				tty_shadow_set(tty, atx + ux + width, aty, 1, &tsc);
 			memcpy(buf + len, gcp->data.data, gcp->data.size);
 			len += gcp->data.size;
 			width += gcp->data.width;
+
+			if (match) {
+				same++;
+				samelen += gcp->data.size;
+				samewidth += gcp->data.width;
+			} else {
+				same = samewidth = 0;
+				samelen = 0;
+			}
+		}
+
+		/*
+		 * If there is a long enough run of cells at the end of the
+		 * buffer which the terminal already has, take them out and
+		 * move the cursor over them instead.
+		 */
+		if (same == TTY_SHADOW_RUN) {
+			len -= samelen;
+			width -= samewidth;
+			skipped = samewidth;
+			skipping = 1;
+
+			same = samewidth = 0;
+			samelen = 0;
 		}
 	}
 	if (len != 0 && ((~last.flags & GRID_FLAG_CLEARED) || last.bg != 8)) {
 		tty_attributes(tty, &last, defaults, palette);
+		tty->flags |= TTY_SHADOWSET;
 		if (last.flags & GRID_FLAG_CLEARED) {
 			log_debug("%s: %zu cleared (end)", __func__, len);
 			tty_clear_line(tty, defaults, aty, atx + ux, width,
 			    last.bg);
+			tty_draw_line_cleared(tty, &last, defaults, palette,
+			    atx + ux, aty, width);
 		} else {
 			if (!wrapped || atx != 0 || ux != 0)
 				tty_cursor(tty, atx + ux, aty);
 			tty_putn(tty, buf, len, width);
 		}
-		ux += width;
-	}
+		tty->flags &= ~TTY_SHADOWSET;
+		ux += width + skipped;
+	} else if (len == 0)
+		ux += skipped;
 
 	if (!cleared && ux < nx) {
 		log_debug("%s: %u to end of line (%zu cleared)", __func__,
 		    nx - ux, len);
-		tty_default_attributes(tty, defaults, palette, 8);
-		tty_clear_line(tty, defaults, aty, atx + ux, nx - ux, 8);
+		if (tty->shadow != NULL) {
+			tty_shadow_resolve(tty, &grid_default_cell, defaults,
+			    palette, &tsc);
+		}
+		if (tty->shadow == NULL ||
+		    !tty_shadow_same(tty, atx + ux, aty, nx - ux, &tsc)) {
+			tty_default_attributes(tty, defaults, palette, 8);
+			tty->flags |= TTY_SHADOWSET;
+			tty_clear_line(tty, defaults, aty, atx + ux, nx - ux,
+			    8);
+			tty->flags &= ~TTY_SHADOWSET;
+			tty_shadow_set(tty, atx + ux, aty, nx - ux, &tsc);
+		}
 	}
 
 	tty->flags = (tty->flags & ~TTY_NOCURSOR) | flags;
@@ -1471,15 +1962,191 @@ tty_client_ready(struct client *c)
 	return (1);
 }
 
+/* Can this client share output with other clients? */
+static int
+tty_share_ready(struct client *c)
+{
+	struct tty	*tty = &c->tty;
+
+	if (c->overlay_check != NULL || tty->shadow != NULL)
+		return (0);
+	if ((~tty->flags & TTY_STARTED) || (tty->flags & TTY_BLOCK))
+		return (0);
+	return (1);
+}
+
+/* Save the state of a terminal. Returns 0 if it cannot be saved. */
+static int
+tty_share_save(struct tty *tty, struct tty_state *ts)
+{
+	if (strlcpy(ts->ccolour, tty->ccolour, sizeof ts->ccolour) >=
+	    sizeof ts->ccolour)
+		return (0);
+
+	ts->cx = tty->cx;
+	ts->cy = tty->cy;
+	ts->cstyle = tty->cstyle;
+	ts->mode = tty->mode;
+
+	ts->rlower = tty->rlower;
+	ts->rupper = tty->rupper;
+	ts->rleft = tty->rleft;
+	ts->rright = tty->rright;
+
+	memcpy(&ts->cell, &tty->cell, sizeof ts->cell);
+	memcpy(&ts->last_cell, &tty->last_cell, sizeof ts->last_cell);
+
+	ts->flags = (tty->flags & TTY_SHARE_FLAGS);
+	return (1);
+}
+
+/* Check if two saved cells will give the same attributes. */
+static int
+tty_share_same_cell(const struct grid_cell *gc1, const struct grid_cell *gc2)
+{
+	return (gc1->attr == gc2->attr &&
+	    gc1->fg == gc2->fg &&
+	    gc1->bg == gc2->bg &&
+	    gc1->us == gc2->us);
+}
+
+/* Check if a terminal and command would give the same output as shared. */
+static int
+tty_share_match(struct tty_share *ts, struct tty *tty,
+    const struct tty_ctx *ctx)
+{
+	struct tty		*from = ts->tty;
+	struct tty_state	*st = &ts->before;
+
+	if (tty->sx != from->sx || tty->sy != from->sy)
+		return (0);
+	if ((tty->client->flags & CLIENT_UTF8) !=
+	    (from->client->flags & CLIENT_UTF8))
+		return (0);
+	if (tty->term != from->term &&
+	    (strcmp(tty->term->name, from->term->name) != 0 ||
+	    tty->term->flags != from->term->flags ||
+	    tty->term->features != from->term->features))
+		return (0);
+
+	if (ctx->xoff != ts->ctx.xoff ||
+	    ctx->yoff != ts->ctx.yoff ||
+	    ctx->rxoff != ts->ctx.rxoff ||
+	    ctx->ryoff != ts->ctx.ryoff ||
+	    ctx->sx != ts->ctx.sx ||
+	    ctx->sy != ts->ctx.sy ||
+	    ctx->bigger != ts->ctx.bigger ||
+	    ctx->wox != ts->ctx.wox ||
+	    ctx->woy != ts->ctx.woy ||
+	    ctx->wsx != ts->ctx.wsx ||
+	    ctx->wsy != ts->ctx.wsy)
+		return (0);
+
+	if (tty->cx != st->cx ||
+	    tty->cy != st->cy ||
+	    tty->cstyle != st->cstyle ||
+	    strcmp(tty->ccolour, st->ccolour) != 0 ||
+	    tty->mode != st->mode ||
+	    tty->rlower != st->rlower ||
+	    tty->rupper != st->rupper ||
+	    tty->rleft != st->rleft ||
+	    tty->rright != st->rright ||
+	    (tty->flags & TTY_SHARE_FLAGS) != st->flags)
+		return (0);
+	if (!tty_share_same_cell(&tty->cell, &st->cell) ||
+	    !tty_share_same_cell(&tty->last_cell, &st->last_cell))
+		return (0);
+	return (1);
+}
+
+/* Copy shared output to a terminal and update its state to match. */
+static void
+tty_share_copy(struct tty_share *ts, struct tty *tty)
+{
+	struct tty_state	*st = &ts->after;
+	size_t			 size = EVBUFFER_LENGTH(ts->out);
+
+	log_debug("%s: %zu bytes shared from %s", tty->client->name, size,
+	    ts->tty->client->name);
+	if (size != 0)
+		tty_add(tty, EVBUFFER_DATA(ts->out), size);
+
+	tty->cx = st->cx;
+	tty->cy = st->cy;
+	tty->cstyle = st->cstyle;
+	if (strcmp(tty->ccolour, st->ccolour) != 0) {
+		free(tty->ccolour);
+		tty->ccolour = xstrdup(st->ccolour);
+	}
+	tty->mode = st->mode;
+
+	tty->rlower = st->rlower;
+	tty->rupper = st->rupper;
+	tty->rleft = st->rleft;
+	tty->rright = st->rright;
+
+	memcpy(&tty->cell, &st->cell, sizeof tty->cell);
+	memcpy(&tty->last_cell, &st->last_cell, sizeof tty->last_cell);
+
+	tty->flags = (tty->flags & ~TTY_SHARE_FLAGS) | st->flags;
+}
+
+/*
+ * Write a command to a terminal and keep the output so it can be shared.
+ * Returns 0 if it cannot be shared.
+ */
+static int
+tty_share_write(struct tty_share *ts,
+    void (*cmdfn)(struct tty *, const struct tty_ctx *), struct tty *tty,
+    const struct tty_ctx *ctx)
+{
+	if (ts->out == NULL)
+		ts->out = evbuffer_new();
+	if (ts->out == NULL)
+		fatalx("out of memory");
+
+	ts->tty = tty;
+	memcpy(&ts->ctx, ctx, sizeof ts->ctx);
+	if (!tty_share_save(tty, &ts->before)) {
+		cmdfn(tty, ctx);
+		return (0);
+	}
+
+	tty_sharing = ts;
+	cmdfn(tty, ctx);
+	tty_sharing = NULL;
+
+	if (!tty_share_save(tty, &ts->after) ||
+	    !tty_share_ready(tty->client)) {
+		evbuffer_drain(ts->out, EVBUFFER_LENGTH(ts->out));
+		return (0);
+	}
+	return (1);
+}
+
 void
 tty_write(void (*cmdfn)(struct tty *, const struct tty_ctx *),
     struct tty_ctx *ctx)
 {
-	struct client	*c;
-	int		 state;
+	static struct tty_share	 shares[TTY_SHARE_MAX];
+	struct tty_share	*ts;
+	struct client		*c;
+	u_int			 i, n = 0, nshares = 0;
+	int			 state;
 
 	if (ctx->set_client_cb == NULL)
 		return;
+
+	/*
+	 * Clients with the same terminal in the same state are given the
+	 * output written to the first of them rather than working it out
+	 * again. Don't bother unless there is more than one such client.
+	 */
+	TAILQ_FOREACH(c, &clients, entry) {
+		if (tty_client_ready(c) && tty_share_ready(c) && ++n == 2)
+			break;
+	}
+
 	TAILQ_FOREACH(c, &clients, entry) {
 		if (!tty_client_ready(c))
 			continue;
@@ -1488,7 +2155,26 @@ tty_write(void (*cmdfn)(struct tty *, const struct tty_ctx *),
 			break;
 		if (state == 0)
 			continue;
-		cmdfn(&c->tty, ctx);
+		if (n < 2 || !tty_share_ready(c)) {
+			cmdfn(&c->tty, ctx);
+			continue;
+		}
+
+		for (i = 0; i < nshares; i++) {
+			if (tty_share_match(&shares[i], &c->tty, ctx))
+				break;
+		}
+		if (i != nshares)
+			tty_share_copy(&shares[i], &c->tty);
+		else if (nshares == TTY_SHARE_MAX)
+			cmdfn(&c->tty, ctx);
+		else if (tty_share_write(&shares[nshares], cmdfn, &c->tty, ctx))
+			nshares++;
+	}
+
+	for (i = 0; i < nshares; i++) {
+		ts = &shares[i];
+		evbuffer_drain(ts->out, EVBUFFER_LENGTH(ts->out));
 	}
 }
 
@@ -1929,6 +2615,9 @@ tty_cell(struct tty *tty, const struct grid_cell *gc,
     const struct grid_cell *defaults, int *palette)
 {
 	const struct grid_cell	*gcp;
+	struct tty_shadow_cell	 tsc;
+	u_int			 cx = tty->cx, cy = tty->cy;
+	int			 shadow = 0;
 
 	/* Skip last character if terminal is stupid. */
 	if ((tty->term->flags & TERM_NOAM) &&
@@ -1940,8 +2629,18 @@ tty_cell(struct tty *tty, const struct grid_cell *gc,
 	if (gc->flags & GRID_FLAG_PADDING)
 		return;
 
-	/* Check the output codeset and apply attributes. */
+	/* Check the output codeset. */
 	gcp = tty_check_codeset(tty, gc);
+
+	/* Nothing to do if the terminal already has this cell. */
+	if (tty->shadow != NULL && cx < tty->sx && cy < tty->sy) {
+		tty_shadow_resolve(tty, gcp, defaults, palette, &tsc);
+		if (tty_shadow_same(tty, cx, cy, 1, &tsc))
+			return;
+		shadow = 1;
+	}
+
+	/* Apply attributes. */
 	tty_attributes(tty, gcp, defaults, palette);
 
 	/* If it is a single character, write with putc to handle ACS. */
@@ -1950,11 +2649,12 @@ tty_cell(struct tty *tty, const struct grid_cell *gc,
 		if (*gcp->data.data < 0x20 || *gcp->data.data == 0x7f)
 			return;
 		tty_putc(tty, *gcp->data.data);
-		return;
+	} else {
+		/* Write the data. */
+		tty_putn(tty, gcp->data.data, gcp->data.size, gcp->data.width);
 	}
-
-	/* Write the data. */
-	tty_putn(tty, gcp->data.data, gcp->data.size, gcp->data.width);
+	if (shadow)
+		tty_shadow_set(tty, cx, cy, 1, &tsc);
 }
 
 void
@@ -1974,6 +2674,8 @@ tty_reset(struct tty *tty)
 static void
 tty_invalidate(struct tty *tty)
 {
+	tty_shadow_invalidate_all(tty);
+
 	memcpy(&tty->cell, &grid_default_cell, sizeof tty->cell);
 	memcpy(&tty->last_cell, &grid_default_cell, sizeof tty->last_cell);
 
@@ -2104,140 +2806,304 @@ tty_cursor_pane(struct tty *tty, const struct tty_ctx *ctx, u_int cx, u_int cy)
 	tty_cursor(tty, ctx->xoff + cx - ctx->wox, ctx->yoff + cy - ctx->woy);
 }
 
-/* Move cursor to absolute position. */
-void
-tty_cursor(struct tty *tty, u_int cx, u_int cy)
+/* Cost of a cursor movement which is not possible. */
+#define TTY_CURSOR_INFINITY 1000000
+
+/* Ways to move the cursor along a row or column. */
+enum tty_cursor_move {
+	TTY_MOVE_NONE,
+	TTY_MOVE_ABSOLUTE,
+	TTY_MOVE_ONE,
+	TTY_MOVE_MANY,
+	TTY_MOVE_NEWLINE,
+	TTY_MOVE_RETURN,
+	TTY_MOVE_OVERWRITE,
+};
+
+/* Get the length of a capability with one parameter. */
+static u_int
+tty_cursor_cost(struct tty *tty, enum tty_code_code code, int a)
 {
-	struct tty_term	*term = tty->term;
-	u_int		 thisx, thisy;
-	int		 change;
+	size_t	len;
 
-	if (tty->flags & TTY_BLOCK)
-		return;
+	if (!tty_term_has(tty->term, code))
+		return (TTY_CURSOR_INFINITY);
+	if (a == -1)
+		len = tty_term_length(tty->term, code);
+	else
+		tty_term_format(tty->term, code, a, 0, 0, &len);
+	if (len == 0)
+		return (TTY_CURSOR_INFINITY);
+	return (len);
+}
 
-	if (cx > tty->sx - 1)
-		cx = tty->sx - 1;
+/*
+ * Can the cursor be moved right from x1 to x2 on row y by printing what is
+ * already there again? This needs the shadow to know every cell and the
+ * current attributes to be the same as the cells have.
+ */
+static int
+tty_cursor_overwrite(struct tty *tty, u_int y, u_int x1, u_int x2)
+{
+	struct tty_shadow	*ts = tty->shadow;
+	struct tty_shadow_cell	*c;
+	struct grid_cell	*tc = &tty->cell;
+	u_int			 x;
 
-	thisx = tty->cx;
-	thisy = tty->cy;
+	if (ts == NULL || y >= ts->sy || x2 >= ts->sx || !ts->lines[y])
+		return (0);
+	if (tty_use_margin(tty) || (tc->attr & GRID_ATTR_CHARSET))
+		return (0);
+	for (x = x1; x < x2; x++) {
+		c = &ts->cells[(size_t)y * ts->sx + x];
+		if (c->width != 1 || c->size != 1 ||
+		    c->data[0] < 0x20 || c->data[0] > 0x7e)
+			return (0);
+		if (c->attr != tc->attr ||
+		    c->fg != tc->fg ||
+		    c->bg != tc->bg ||
+		    c->us != tc->us)
+			return (0);
+	}
+	return (1);
+}
 
-	/* No change. */
-	if (cx == thisx && cy == thisy)
-		return;
+/* Work out the cheapest way to move within a row and do it if wanted. */
+static u_int
+tty_cursor_column(struct tty *tty, u_int y, u_int from, u_int to, int output)
+{
+	struct tty_shadow	*ts = tty->shadow;
+	enum tty_cursor_move	 move = TTY_MOVE_ABSOLUTE;
+	enum tty_code_code	 one, many;
+	u_int			 n, cost, best, i;
 
-	/* Very end of the line, just use absolute movement. */
-	if (thisx > tty->sx - 1)
-		goto absolute;
+	if (from == to)
+		return (0);
+	best = tty_cursor_cost(tty, TTYC_HPA, to);
 
-	/* Move to home position (0, 0). */
-	if (cx == 0 && cy == 0 && tty_term_has(term, TTYC_HOME)) {
-		tty_putcode(tty, TTYC_HOME);
+	/* To the left edge. */
+	if (to == 0 && (!tty_use_margin(tty) || tty->rleft == 0)) {
+		if (best > 1) {
+			best = 1;
+			move = TTY_MOVE_RETURN;
+		}
 		goto out;
 	}
 
-	/* Zero on the next line. */
-	if (cx == 0 && cy == thisy + 1 && thisy != tty->rlower &&
-	    (!tty_use_margin(tty) || tty->rleft == 0)) {
-		tty_putc(tty, '\r');
-		tty_putc(tty, '\n');
+	if (to < from) {
+		n = from - to;
+		one = TTYC_CUB1;
+		many = TTYC_CUB;
+	} else {
+		n = to - from;
+		one = TTYC_CUF1;
+		many = TTYC_CUF;
+	}
+
+	/* With margins, only a single step is safe. */
+	if (tty_use_margin(tty) && n != 1)
 		goto out;
+	cost = tty_cursor_cost(tty, one, -1);
+	if (cost != TTY_CURSOR_INFINITY && cost * n < best) {
+		best = cost * n;
+		move = TTY_MOVE_ONE;
+	}
+	cost = tty_cursor_cost(tty, many, n);
+	if (cost < best) {
+		best = cost;
+		move = TTY_MOVE_MANY;
+	}
+	if (to > from && n < best && tty_cursor_overwrite(tty, y, from, to)) {
+		best = n;
+		move = TTY_MOVE_OVERWRITE;
 	}
 
-	/* Moving column or row. */
-	if (cy == thisy) {
-		/*
-		 * Moving column only, row staying the same.
-		 */
+out:
+	if (!output || best == TTY_CURSOR_INFINITY)
+		return (best);
+	switch (move) {
+	case TTY_MOVE_ABSOLUTE:
+		tty_putcode1(tty, TTYC_HPA, to);
+		break;
+	case TTY_MOVE_RETURN:
+		tty_putc(tty, '\r');
+		break;
+	case TTY_MOVE_ONE:
+		for (i = 0; i < n; i++)
+			tty_putcode(tty, one);
+		break;
+	case TTY_MOVE_MANY:
+		tty_putcode1(tty, many, n);
+		break;
+	case TTY_MOVE_OVERWRITE:
+		for (i = from; i < to; i++)
+			tty_add(tty, ts->cells[(size_t)y * ts->sx + i].data, 1);
+		break;
+	default:
+		break;
+	}
+	return (best);
+}
+
+/* Work out the cheapest way to move within a column and do it if wanted. */
+static u_int
+tty_cursor_row(struct tty *tty, u_int from, u_int to, int output)
+{
+	enum tty_cursor_move	 move = TTY_MOVE_ABSOLUTE;
+	enum tty_code_code	 one, many;
+	u_int			 n, cost, best, i, lo, hi;
+
+	if (from == to)
+		return (0);
+	best = tty_cursor_cost(tty, TTYC_VPA, to);
 
-		/* To left edge. */
-		if (cx == 0 && (!tty_use_margin(tty) || tty->rleft == 0)) {
-			tty_putc(tty, '\r');
-			goto out;
-		}
+	/*
+	 * Relative movement stops at the scroll region edges, so can only be
+	 * used if the move does not cross one.
+	 */
+	lo = (from < to) ? from : to;
+	hi = (from < to) ? to : from;
+	if (tty->rupper == UINT_MAX ||
+	    (lo < tty->rupper && hi >= tty->rupper) ||
+	    (lo <= tty->rlower && hi > tty->rlower))
+		goto out;
+	n = hi - lo;
 
-		/* One to the left. */
-		if (cx == thisx - 1 && tty_term_has(term, TTYC_CUB1)) {
-			tty_putcode(tty, TTYC_CUB1);
-			goto out;
+	if (to < from) {
+		one = TTYC_CUU1;
+		many = TTYC_CUU;
+	} else {
+		one = TTYC_CUD1;
+		many = TTYC_CUD;
+		if (n < best) {
+			best = n;
+			move = TTY_MOVE_NEWLINE;
 		}
+	}
+	cost = tty_cursor_cost(tty, one, -1);
+	if (cost != TTY_CURSOR_INFINITY && cost * n < best) {
+		best = cost * n;
+		move = TTY_MOVE_ONE;
+	}
+	cost = tty_cursor_cost(tty, many, n);
+	if (cost < best) {
+		best = cost;
+		move = TTY_MOVE_MANY;
+	}
 
-		/* One to the right. */
-		if (cx == thisx + 1 && tty_term_has(term, TTYC_CUF1)) {
-			tty_putcode(tty, TTYC_CUF1);
-			goto out;
-		}
+out:
+	if (!output || best == TTY_CURSOR_INFINITY)
+		return (best);
+	switch (move) {
+	case TTY_MOVE_ABSOLUTE:
+		tty_putcode1(tty, TTYC_VPA, to);
+		break;
+	case TTY_MOVE_NEWLINE:
+		for (i = 0; i < n; i++)
+			tty_putc(tty, '\n');
+		break;
+	case TTY_MOVE_ONE:
+		for (i = 0; i < n; i++)
+			tty_putcode(tty, one);
+		break;
+	case TTY_MOVE_MANY:
+		tty_putcode1(tty, many, n);
+		break;
+	default:
+		break;
+	}
+	return (best);
+}
 
-		/* Calculate difference. */
-		change = thisx - cx;	/* +ve left, -ve right */
+/*
+ * Move cursor to absolute position. This picks whichever of absolute
+ * movement, relative movement, or relative movement from the home position
+ * or the start of the line is shortest for the terminal.
+ */
+void
+tty_cursor(struct tty *tty, u_int cx, u_int cy)
+{
+	u_int	thisx, thisy, cost, best;
+	size_t	len;
+	enum {
+		TTY_CURSOR_ABSOLUTE,
+		TTY_CURSOR_RELATIVE,
+		TTY_CURSOR_HOME,
+		TTY_CURSOR_RETURN
+	} how = TTY_CURSOR_ABSOLUTE;
 
-		/*
-		 * Use HPA if change is larger than absolute, otherwise move
-		 * the cursor with CUB/CUF.
-		 */
-		if ((u_int) abs(change) > cx && tty_term_has(term, TTYC_HPA)) {
-			tty_putcode1(tty, TTYC_HPA, cx);
-			goto out;
-		} else if (change > 0 &&
-		    tty_term_has(term, TTYC_CUB) &&
-		    !tty_use_margin(tty)) {
-			if (change == 2 && tty_term_has(term, TTYC_CUB1)) {
-				tty_putcode(tty, TTYC_CUB1);
-				tty_putcode(tty, TTYC_CUB1);
-				goto out;
-			}
-			tty_putcode1(tty, TTYC_CUB, change);
-			goto out;
-		} else if (change < 0 &&
-		    tty_term_has(term, TTYC_CUF) &&
-		    !tty_use_margin(tty)) {
-			tty_putcode1(tty, TTYC_CUF, -change);
-			goto out;
-		}
-	} else if (cx == thisx) {
-		/*
-		 * Moving row only, column staying the same.
-		 */
+	if (tty->flags & TTY_BLOCK)
+		return;
 
-		/* One above. */
-		if (thisy != tty->rupper &&
-		    cy == thisy - 1 && tty_term_has(term, TTYC_CUU1)) {
-			tty_putcode(tty, TTYC_CUU1);
-			goto out;
-		}
+	if (cx > tty->sx - 1)
+		cx = tty->sx - 1;
 
-		/* One below. */
-		if (thisy != tty->rlower &&
-		    cy == thisy + 1 && tty_term_has(term, TTYC_CUD1)) {
-			tty_putcode(tty, TTYC_CUD1);
-			goto out;
-		}
+	thisx = tty->cx;
+	thisy = tty->cy;
 
-		/* Calculate difference. */
-		change = thisy - cy;	/* +ve up, -ve down */
+	/* No change. */
+	if (cx == thisx && cy == thisy)
+		return;
 
-		/*
-		 * Try to use VPA if change is larger than absolute or if this
-		 * change would cross the scroll region, otherwise use CUU/CUD.
-		 */
-		if ((u_int) abs(change) > cy ||
-		    (change < 0 && cy - change > tty->rlower) ||
-		    (change > 0 && cy - change < tty->rupper)) {
-			    if (tty_term_has(term, TTYC_VPA)) {
-				    tty_putcode1(tty, TTYC_VPA, cy);
-				    goto out;
-			    }
-		} else if (change > 0 && tty_term_has(term, TTYC_CUU)) {
-			tty_putcode1(tty, TTYC_CUU, change);
-			goto out;
-		} else if (change < 0 && tty_term_has(term, TTYC_CUD)) {
-			tty_putcode1(tty, TTYC_CUD, -change);
-			goto out;
+	/* Very end of the line or unknown, just use absolute movement. */
+	if (thisx > tty->sx - 1 || thisy > tty->sy - 1) {
+		tty_putcode2(tty, TTYC_CUP, cy, cx);
+		goto out;
+	}
+
+	tty_term_format(tty->term, TTYC_CUP, cy, cx, 0, &len);
+	best = len;
+
+	/* Relative to the current position. */
+	cost = tty_cursor_row(tty, thisy, cy, 0);
+	if (cost < best)
+		cost += tty_cursor_column(tty, cy, thisx, cx, 0);
+	if (cost < best) {
+		best = cost;
+		how = TTY_CURSOR_RELATIVE;
+	}
+
+	/* Relative to the home position (0, 0). */
+	cost = tty_cursor_cost(tty, TTYC_HOME, -1);
+	if (cost < best)
+		cost += tty_cursor_row(tty, 0, cy, 0);
+	if (cost < best)
+		cost += tty_cursor_column(tty, cy, 0, cx, 0);
+	if (cost < best) {
+		best = cost;
+		how = TTY_CURSOR_HOME;
+	}
+
+	/* Relative to the start of this line. */
+	if (cx != 0 && (!tty_use_margin(tty) || tty->rleft == 0)) {
+		cost = 1 + tty_cursor_row(tty, thisy, cy, 0);
+		if (cost < best)
+			cost += tty_cursor_column(tty, cy, 0, cx, 0);
+		if (cost < best) {
+			best = cost;
+			how = TTY_CURSOR_RETURN;
 		}
 	}
 
-absolute:
-	/* Absolute movement. */
-	tty_putcode2(tty, TTYC_CUP, cy, cx);
+	switch (how) {
+	case TTY_CURSOR_ABSOLUTE:
+		tty_putcode2(tty, TTYC_CUP, cy, cx);
+		break;
+	case TTY_CURSOR_RELATIVE:
+		tty_cursor_row(tty, thisy, cy, 1);
+		tty_cursor_column(tty, cy, thisx, cx, 1);
+		break;
+	case TTY_CURSOR_HOME:
+		tty_putcode(tty, TTYC_HOME);
+		tty_cursor_row(tty, 0, cy, 1);
+		tty_cursor_column(tty, cy, 0, cx, 1);
+		break;
+	case TTY_CURSOR_RETURN:
+		tty_putc(tty, '\r');
+		tty_cursor_row(tty, thisy, cy, 1);
+		tty_cursor_column(tty, cy, 0, cx, 1);
+		break;
+	}
 
 out:
 	tty->cx = cx;
@@ -2265,22 +3131,8 @@ tty_attributes(struct tty *tty, const struct grid_cell *gc,
 	    gc2.us == tty->last_cell.us)
 		return;
 
-	/*
-	 * If no setab, try to use the reverse attribute as a best-effort for a
-	 * non-default background. This is a bit of a hack but it doesn't do
-	 * any serious harm and makes a couple of applications happier.
-	 */
-	if (!tty_term_has(tty->term, TTYC_SETAB)) {
-		if (gc2.attr & GRID_ATTR_REVERSE) {
-			if (gc2.fg != 7 && !COLOUR_DEFAULT(gc2.fg))
-				gc2.attr &= ~GRID_ATTR_REVERSE;
-		} else {
-			if (gc2.bg != 0 && !COLOUR_DEFAULT(gc2.bg))
-				gc2.attr |= GRID_ATTR_REVERSE;
-		}
-	}
-
 	/* Fix up the colours if necessary. */
+	tty_check_reverse(tty, &gc2);
 	tty_check_fg(tty, palette, &gc2);
 	tty_check_bg(tty, palette, &gc2);
 	tty_check_us(tty, palette, &gc2);
@@ -2403,6 +3255,25 @@ tty_colours(struct tty *tty, const struct grid_cell *gc)
 		tty_colours_us(tty, gc);
 }
 
+static void
+tty_check_reverse(struct tty *tty, struct grid_cell *gc)
+{
+	/*
+	 * If no setab, try to use the reverse attribute as a best-effort for a
+	 * non-default background. This is a bit of a hack but it doesn't do
+	 * any serious harm and makes a couple of applications happier.
+	 */
+	if (tty_term_has(tty->term, TTYC_SETAB))
+		return;
+	if (gc->attr & GRID_ATTR_REVERSE) {
+		if (gc->fg != 7 && !COLOUR_DEFAULT(gc->fg))
+			gc->attr &= ~GRID_ATTR_REVERSE;
+	} else {
+		if (gc->bg != 0 && !COLOUR_DEFAULT(gc->bg))
+			gc->attr |= GRID_ATTR_REVERSE;
+	}
+}
+
 static void
 tty_check_fg(struct tty *tty, int *palette, struct grid_cell *gc)
 {
@@ -19,49 +19,37 @@
 #include <sys/types.h>
 
 #include <ctype.h>
-#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
-#include <wchar.h>
 
 #include "tmux.h"
 
+/*
+ * UTF-8 characters too big to fit into a utf8_char are stored in a table and
+ * the index is used instead. Items are found by data with an open addressing
+ * hash table and by index with an array. Each item is reference counted and
+ * freed when no longer used, and the indexes of freed items are reused.
+ */
 struct utf8_item {
-	RB_ENTRY(utf8_item)	index_entry;
 	u_int			index;
+	u_int			references;
+	u_int			hash;
 
-	RB_ENTRY(utf8_item)	data_entry;
 	char			data[UTF8_SIZE];
 	u_char			size;
 };
 
-static int
-utf8_data_cmp(struct utf8_item *ui1, struct utf8_item *ui2)
-{
-	if (ui1->size < ui2->size)
-		return (-1);
-	if (ui1->size > ui2->size)
-		return (1);
-	return (memcmp(ui1->data, ui2->data, ui1->size));
-}
-RB_HEAD(utf8_data_tree, utf8_item);
-RB_GENERATE_STATIC(utf8_data_tree, utf8_item, data_entry, utf8_data_cmp);
-static struct utf8_data_tree utf8_data_tree = RB_INITIALIZER(utf8_data_tree);
+static struct utf8_item	**utf8_table;
+static u_int		  utf8_table_size;
+static u_int		  utf8_table_used;
 
-static int
-utf8_index_cmp(struct utf8_item *ui1, struct utf8_item *ui2)
-{
-	if (ui1->index < ui2->index)
-		return (-1);
-	if (ui1->index > ui2->index)
-		return (1);
-	return (0);
-}
-RB_HEAD(utf8_index_tree, utf8_item);
-RB_GENERATE_STATIC(utf8_index_tree, utf8_item, index_entry, utf8_index_cmp);
-static struct utf8_index_tree utf8_index_tree = RB_INITIALIZER(utf8_index_tree);
+static struct utf8_item	**utf8_items;
+static u_int		 *utf8_free_indexes;
+static u_int		  utf8_items_size;
+static u_int		  utf8_free_size;
+static u_int		  utf8_next_index;
 
-static u_int utf8_next_index;
+static u_int		  utf8_ambiguous_width = 1;
 
 #define UTF8_GET_SIZE(uc) (((uc) >> 24) & 0x1f)
 #define UTF8_GET_WIDTH(flags) (((uc) >> 29) - 1)
@@ -69,30 +57,110 @@ static u_int utf8_next_index;
 #define UTF8_SET_SIZE(size) (((utf8_char)(size)) << 24)
 #define UTF8_SET_WIDTH(width) ((((utf8_char)(width)) + 1) << 29)
 
-/* Get a UTF-8 item from data. */
-static struct utf8_item *
-utf8_item_by_data(const char *data, size_t size)
+/* Hash UTF-8 data. */
+static u_int
+utf8_hash(const char *data, size_t size)
+{
+	u_int	hash = 2166136261U;
+	size_t	i;
+
+	for (i = 0; i < size; i++) {
+		hash ^= (u_char)data[i];
+		hash *= 16777619U;
+	}
+	return (hash);
+}
+
+/* Find the slot for UTF-8 data, either where it is or an empty slot. */
+static u_int
+utf8_table_slot(const char *data, size_t size, u_int hash)
+{
+	struct utf8_item	*ui;
+	u_int			 mask = utf8_table_size - 1, slot;
+
+	for (slot = hash & mask;; slot = (slot + 1) & mask) {
+		ui = utf8_table[slot];
+		if (ui == NULL)
+			return (slot);
+		if (ui->hash == hash &&
+		    ui->size == size &&
+		    memcmp(ui->data, data, size) == 0)
+			return (slot);
+	}
+}
+
+/* Make the table bigger if it is more than half full. */
+static void
+utf8_table_grow(void)
+{
+	struct utf8_item	**old = utf8_table, *ui;
+	u_int			  old_size = utf8_table_size, i;
+
+	if ((utf8_table_used + 1) * 2 <= utf8_table_size)
+		return;
+
+	if (utf8_table_size == 0)
+		utf8_table_size = 64;
+	else
+		utf8_table_size *= 2;
+	utf8_table = xcalloc(utf8_table_size, sizeof *utf8_table);
+
+	for (i = 0; i < old_size; i++) {
+		if ((ui = old[i]) == NULL)
+			continue;
+		utf8_table[utf8_table_slot(ui->data, ui->size, ui->hash)] = ui;
+	}
+	free(old);
+}
+
+/*
+ * Remove an item from the table. Following items are moved back into the
+ * space if it is between them and their home slot, so there are no gaps in
+ * the probe sequences.
+ */
+static void
+utf8_table_remove(struct utf8_item *ui)
 {
-	struct utf8_item	ui;
+	u_int	mask = utf8_table_size - 1, slot, next, home;
 
-	memcpy(ui.data, data, size);
-	ui.size = size;
+	slot = utf8_table_slot(ui->data, ui->size, ui->hash);
+	utf8_table[slot] = NULL;
+	utf8_table_used--;
 
-	return (RB_FIND(utf8_data_tree, &utf8_data_tree, &ui));
+	for (next = (slot + 1) & mask;; next = (next + 1) & mask) {
+		if ((ui = utf8_table[next]) == NULL)
+			break;
+		home = ui->hash & mask;
+		if (slot <= next) {
+			if (home > slot && home <= next)
+				continue;
+		} else if (home > slot || home <= next)
+			continue;
+		utf8_table[slot] = ui;
+		utf8_table[next] = NULL;
+		slot = next;
+	}
 }
 
 /* Get a UTF-8 item from data. */
 static struct utf8_item *
-utf8_item_by_index(u_int index)
+utf8_item_by_data(const char *data, size_t size)
 {
-	struct utf8_item	ui;
-
-	ui.index = index;
+	if (utf8_table_used == 0)
+		return (NULL);
+	return (utf8_table[utf8_table_slot(data, size, utf8_hash(data, size))]);
+}
 
-	return (RB_FIND(utf8_index_tree, &utf8_index_tree, &ui));
+/* Get a UTF-8 item from index. */
+static struct utf8_item *
+utf8_item_by_index(u_int index)
+{
+	if (index >= utf8_next_index)
+		return (NULL);
+	return (utf8_items[index]);
 }
 
-/* Add a UTF-8 item. */
+/* Add a UTF-8 item or a reference to it if it already exists. */
 static int
 utf8_put_item(const char *data, size_t size, u_int *index)
 {
@@ -100,28 +168,89 @@ utf8_put_item(const char *data, size_t size, u_int *index)
 
 	ui = utf8_item_by_data(data, size);
 	if (ui != NULL) {
+		ui->references++;
+		*index = ui->index;
 		log_debug("%s: found %.*s = %u", __func__, (int)size, data,
 		    *index);
-		*index = ui->index;
 		return (0);
 	}
 
-	if (utf8_next_index == 0xffffff + 1)
-		return (-1);
-
 	ui = xcalloc(1, sizeof *ui);
-	ui->index = utf8_next_index++;
-	RB_INSERT(utf8_index_tree, &utf8_index_tree, ui);
+	if (utf8_free_size != 0)
+		ui->index = utf8_free_indexes[--utf8_free_size];
+	else {
+		if (utf8_next_index == 0xffffff + 1) {
+			free(ui);
+			return (-1);
+		}
+		if (utf8_next_index == utf8_items_size) {
+			if (utf8_items_size == 0)
+				utf8_items_size = 64;
+			else
+				utf8_items_size *= 2;
+			utf8_items = xreallocarray(utf8_items, utf8_items_size,
+			    sizeof *utf8_items);
+			utf8_free_indexes = xreallocarray(utf8_free_indexes,
+			    utf8_items_size, sizeof *utf8_free_indexes);
+		}
+		ui->index = utf8_next_index++;
+	}
+	utf8_items[ui->index] = ui;
+	ui->references = 1;
 
 	memcpy(ui->data, data, size);
 	ui->size = size;
-	RB_INSERT(utf8_data_tree, &utf8_data_tree, ui);
+	ui->hash = utf8_hash(data, size);
+
+	utf8_table_grow();
+	utf8_table[utf8_table_slot(data, size, ui->hash)] = ui;
+	utf8_table_used++;
 
-	log_debug("%s: added %.*s = %u", __func__, (int)size, data, *index);
 	*index = ui->index;
+	log_debug("%s: added %.*s = %u", __func__, (int)size, data, *index);
 	return (0);
 }
 
+/* Is this character stored in the table? */
+int
+utf8_in_table(utf8_char uc)
+{
+	return (UTF8_GET_SIZE(uc) > 3);
+}
+
+/* Add a reference to a character. */
+void
+utf8_add_ref(utf8_char uc)
+{
+	struct utf8_item	*ui;
+
+	if (!utf8_in_table(uc))
+		return;
+	if ((ui = utf8_item_by_index(uc & 0xffffff)) != NULL)
+		ui->references++;
+}
+
+/* Remove a reference from a character and free it if no longer used. */
+void
+utf8_remove_ref(utf8_char uc)
+{
+	struct utf8_item	*ui;
+
+	if (!utf8_in_table(uc))
+		return;
+	if ((ui = utf8_item_by_index(uc & 0xffffff)) == NULL)
+		return;
+	if (--ui->references != 0)
+		return;
+	log_debug("%s: removed %.*s = %u", __func__, (int)ui->size, ui->data,
+	    ui->index);
+
+	utf8_table_remove(ui);
+	utf8_items[ui->index] = NULL;
+	utf8_free_indexes[utf8_free_size++] = ui->index;
+	free(ui);
+}
+
 /* Get UTF-8 character from data. */
 enum utf8_state
 utf8_from_data(const struct utf8_data *ud, utf8_char *uc)
@@ -210,41 +339,46 @@ utf8_copy(struct utf8_data *to, const struct utf8_data *from)
 		to->data[i] = '\0';
 }
 
+/* Set the width used for East Asian ambiguous characters. */
+void
+utf8_set_ambiguous_width(u_int width)
+{
+	utf8_ambiguous_width = width;
+}
+
 /* Get width of Unicode character. */
 static enum utf8_state
 utf8_width(struct utf8_data *ud, int *width)
 {
-	wchar_t	wc;
-
-	switch (mbtowc(&wc, ud->data, ud->size)) {
-	case -1:
-		log_debug("UTF-8 %.*s, mbtowc() %d", (int)ud->size, ud->data,
-		    errno);
-		mbtowc(NULL, NULL, MB_CUR_MAX);
+	const u_char	*data = ud->data;
+	u_int		 cp;
+
+	switch (ud->size) {
+	case 2:
+		cp = ((data[0] & 0x1f) << 6)|(data[1] & 0x3f);
+		if (cp < 0x80)
+			return (UTF8_ERROR);
+		break;
+	case 3:
+		cp = ((data[0] & 0x0f) << 12)|((data[1] & 0x3f) << 6)|
+		    (data[2] & 0x3f);
+		if (cp < 0x800 || (cp >= 0xd800 && cp <= 0xdfff))
+			return (UTF8_ERROR);
+		break;
+	case 4:
+		cp = ((data[0] & 0x07) << 18)|((data[1] & 0x3f) << 12)|
+		    ((data[2] & 0x3f) << 6)|(data[3] & 0x3f);
+		if (cp < 0x10000 || cp > 0x10ffff)
+			return (UTF8_ERROR);
+		break;
+	default:
 		return (UTF8_ERROR);
-	case 0:
-		return (UTF8_ERROR);
-	}
-	*width = wcwidth(wc);
-	if (*width >= 0 && *width <= 0xff)
-		return (UTF8_DONE);
-	log_debug("UTF-8 %.*s, wcwidth() %d", (int)ud->size, ud->data, *width);
-
-#ifndef __OpenBSD__
-	/*
-	 * Many platforms (particularly and inevitably OS X) have no width for
-	 * relatively common characters (wcwidth() returns -1); assume width 1
-	 * in this case. This will be wrong for genuinely nonprintable
-	 * characters, but they should be rare. We may pass through stuff that
-	 * ideally we would block, but this is no worse than sending the same
-	 * to the terminal without tmux.
-	 */
-	if (*width < 0) {
-		*width = 1;
-		return (UTF8_DONE);
 	}
-#endif
-	return (UTF8_ERROR);
+
+	*width = utf8_width_lookup(cp);
+	if (*width == 3)
+		*width = utf8_ambiguous_width;
+	return (UTF8_DONE);
 }
 
 /*
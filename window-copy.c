@@ -27,6 +27,7 @@
 #include "tmux.h"
 
 struct window_copy_mode_data;
+struct window_copy_text;
 
 static const char *window_copy_key_table(struct window_mode_entry *);
 static void	window_copy_command(struct window_mode_entry *, struct client *,
@@ -57,10 +58,12 @@ static void	window_copy_scroll_to(struct window_mode_entry *, u_int, u_int,
 		    int);
 static int	window_copy_search_compare(struct grid *, u_int, u_int,
 		    struct grid *, u_int, int);
-static int	window_copy_search_lr(struct grid *, struct grid *, u_int *,
-		    u_int, u_int, u_int, int);
-static int	window_copy_search_rl(struct grid *, struct grid *, u_int *,
-		    u_int, u_int, u_int, int);
+static int	window_copy_search_lr(struct grid *, struct grid *,
+		    struct window_copy_text *, struct window_copy_text *,
+		    u_int *, u_int, u_int, u_int, int);
+static int	window_copy_search_rl(struct grid *, struct grid *,
+		    struct window_copy_text *, struct window_copy_text *,
+		    u_int *, u_int, u_int, u_int, int);
 static int	window_copy_last_regex(struct grid *, u_int, u_int, u_int,
 		    u_int, u_int *, u_int *, const char *, const regex_t *,
 		    int);
@@ -71,12 +74,12 @@ static void	window_copy_cstrtocellpos(struct grid *, u_int, u_int *,
 static int	window_copy_search_marks(struct window_mode_entry *,
 		    struct screen *, int, int);
 static void	window_copy_clear_marks(struct window_mode_entry *);
+static void	window_copy_index_invalidate(struct window_mode_entry *, u_int);
 static void	window_copy_move_left(struct screen *, u_int *, u_int *, int);
 static void	window_copy_move_right(struct screen *, u_int *, u_int *, int);
 static int	window_copy_is_lowercase(const char *);
-static int	window_copy_search_jump(struct window_mode_entry *,
-		    struct grid *, struct grid *, u_int, u_int, u_int, int, int,
-		    int, int);
+static void	window_copy_search_cancel(struct window_mode_entry *);
+static void	window_copy_search_timer(int, short, void *);
 static int	window_copy_search(struct window_mode_entry *, int, int);
 static int	window_copy_search_up(struct window_mode_entry *, int);
 static int	window_copy_search_down(struct window_mode_entry *, int);
@@ -283,6 +286,12 @@ struct window_copy_mode_data {
 #define WINDOW_COPY_SEARCH_TIMEOUT 10000
 #define WINDOW_COPY_SEARCH_ALL_TIMEOUT 200
 
+	struct window_copy_search *search; /* search which is running */
+#define WINDOW_COPY_SEARCH_SLICE 10
+
+	struct window_copy_index *index; /* search index for each line */
+	u_int		 indexsize;
+
 	int		 jumptype;
 	char		 jumpchar;
 
@@ -290,6 +299,73 @@ struct window_copy_mode_data {
 #define WINDOW_COPY_DRAG_REPEAT_TIME 50000
 };
 
+/*
+ * Search index entry for a line. This is a bitmap of the trigrams (sets of
+ * three bytes, lowercased) in the text from the start of the line to the end of
+ * the last line it wraps onto, so lines which cannot match a search string can
+ * be skipped without looking at their cells.
+ */
+struct window_copy_index {
+	uint64_t	 bits[4];
+	int		 built;
+};
+
+/*
+ * Text of a group of wrapped lines, for searching with memmem rather than
+ * comparing cell by cell. If offsets is not NULL, it has the offset in buf of
+ * each cell and one past the last.
+ */
+struct window_copy_text {
+	u_char		*buf;
+	size_t		 len;
+	size_t		 size;
+
+	size_t		*offsets;
+	u_int		 cells;
+
+	int		 valid;
+	u_int		 first;		/* first line in buf */
+	u_int		 last;		/* last line in buf */
+};
+
+/* Compiled search regex kept in the pane. */
+struct window_copy_regex {
+	char		*pattern;
+	int		 cflags;
+	regex_t		 reg;
+};
+
+/*
+ * A search which is running. Searches are done in slices of
+ * WINDOW_COPY_SEARCH_SLICE milliseconds, and a search that does not finish in
+ * the first slice continues from a timer so the server is not blocked.
+ */
+struct window_copy_search {
+	struct screen	 ss;		/* search string */
+	int		 direction;
+	int		 regex;
+	int		 cis;
+	int		 wrap;		/* wrap around if not found */
+	int		 visible_only;	/* only mark visible lines */
+	int		 async;		/* continued from the timer */
+	u_int		 repeat;	/* number of times to search again */
+
+	char		*pattern;	/* regex from the pane cache */
+	int		 cflags;
+	int		 indexed;
+	uint64_t	 bits[4];
+	struct window_copy_text	 needle;
+	struct window_copy_text	 text;
+
+	u_int		 fx;		/* position in the next line */
+	u_int		 py;		/* next line to search */
+	u_int		 endline;	/* last line to search */
+	u_int		 first;		/* line the search started on */
+	u_int		 lines;		/* number of lines searched */
+
+	struct event	 timer;
+};
+
 static void
 window_copy_scroll_timer(__unused int fd, __unused short events, void *arg)
 {
@@ -477,9 +553,11 @@ window_copy_free(struct window_mode_entry *wme)
 	struct window_copy_mode_data	*data = wme->data;
 
 	evtimer_del(&data->dragtimer);
+	window_copy_search_cancel(wme);
 
 	free(data->searchmark);
 	free(data->searchstr);
+	free(data->index);
 
 	screen_free(data->backing);
 	free(data->backing);
@@ -524,6 +602,7 @@ window_copy_vadd(struct window_pane *wp, const char *fmt, va_list ap)
 	old_cy = backing->cy;
 	screen_write_vnputs(&back_ctx, 0, &gc, fmt, ap);
 	screen_write_stop(&back_ctx);
+	window_copy_index_invalidate(wme, old_hsize + old_cy);
 
 	data->oy += screen_hsize(data->backing) - old_hsize;
 
@@ -756,6 +835,7 @@ window_copy_formats(struct window_mode_entry *wme, struct format_tree *ft)
 		format_add(ft, "selection_active", "%d", 0);
 
 	format_add(ft, "search_present", "%d", data->searchmark != NULL);
+	format_add(ft, "search_running", "%d", data->search != NULL);
 	format_add_cb(ft, "search_match", window_copy_search_match_cb);
 
 	format_add_cb(ft, "copy_cursor_word", window_copy_cursor_word_cb);
@@ -802,6 +882,8 @@ window_copy_resize(struct window_mode_entry *wme, u_int sx, u_int sy)
 	screen_resize_cursor(data->backing, sx, sy, 1, 0, 0);
 	if (reflow)
 		grid_unwrap_position(gd, &cx, &cy, wx, wy);
+	window_copy_search_cancel(wme);
+	window_copy_index_invalidate(wme, 0);
 
 	data->cx = cx;
 	if (cy < gd->hsize) {
@@ -2133,10 +2215,12 @@ window_copy_cmd_refresh_from_pane(struct window_copy_cmd_state *cs)
 	if (data->viewmode)
 		return (WINDOW_COPY_CMD_NOTHING);
 
+	window_copy_search_cancel(wme);
 	screen_free(data->backing);
 	free(data->backing);
 	data->backing = window_copy_clone_screen(&wp->base, &data->screen, NULL,
 	    NULL, wme->swp != wme->wp);
+	window_copy_index_invalidate(wme, 0);
 
 	window_copy_size_changed(wme);
 	return (WINDOW_COPY_CMD_REDRAW);
@@ -2307,6 +2391,10 @@ window_copy_command(struct window_mode_entry *wme, struct client *c,
 	if (m != NULL && m->valid && !MOUSE_WHEEL(m->b))
 		window_copy_move_mouse(m);
 
+	/* Any command other than another search stops a running search. */
+	if (strncmp(command, "search-", 7) != 0)
+		window_copy_search_cancel(wme);
+
 	cs.wme = wme;
 	cs.args = args;
 	cs.m = m;
@@ -2384,6 +2472,214 @@ window_copy_scroll_to(struct window_mode_entry *wme, u_int px, u_int py,
 		window_copy_redraw_screen(wme);
 }
 
+/* Forget the search index from a line onwards and any loaded search text. */
+static void
+window_copy_index_invalidate(struct window_mode_entry *wme, u_int py)
+{
+	struct window_copy_mode_data	*data = wme->data;
+	struct grid			*gd = data->backing->grid;
+	u_int				 yy;
+
+	if (data->search != NULL)
+		data->search->text.valid = 0;
+	if (py == 0) {
+		free(data->index);
+		data->index = NULL;
+		data->indexsize = 0;
+		return;
+	}
+
+	/* Lines which wrap onto this one include its text, so forget them. */
+	while (py > 0 && py - 1 < gd->hsize + gd->sy) {
+		if (~grid_peek_line(gd, py - 1)->flags & GRID_LINE_WRAPPED)
+			break;
+		py--;
+	}
+	for (yy = py; yy < data->indexsize; yy++)
+		data->index[yy].built = 0;
+}
+
+/* Add the trigram starting at a position in a buffer to an index entry. */
+static void
+window_copy_index_add(uint64_t *bits, const u_char *p)
+{
+	u_int	h;
+
+	h = ((u_int)p[0] << 16)|((u_int)p[1] << 8)|p[2];
+	h = (h * 2654435761U) >> 24;
+	bits[h >> 6] |= (1ULL << (h & 63));
+}
+
+/*
+ * Append the text of a line to a buffer, recording the offset of each cell if
+ * cells is set. If lower is set, single byte characters are lowercased in the
+ * same way as for a case insensitive search. Cells past the end of the line
+ * are spaces and padding cells have no text.
+ */
+static void
+window_copy_text_append(struct window_copy_text *wct, struct grid *gd,
+    u_int py, int lower, int cells)
+{
+	const struct grid_line		*gl = grid_peek_line(gd, py);
+	const struct grid_cell_entry	*gce;
+	struct utf8_data		 ud;
+	u_int				 px;
+
+	if (cells) {
+		wct->offsets = xreallocarray(wct->offsets,
+		    wct->cells + gd->sx + 1, sizeof *wct->offsets);
+	}
+	for (px = 0; px < gd->sx; px++) {
+		if (wct->len + UTF8_SIZE > wct->size) {
+			wct->size = (wct->size * 2) + gd->sx + UTF8_SIZE;
+			wct->buf = xrealloc(wct->buf, wct->size);
+		}
+		if (cells)
+			wct->offsets[wct->cells++] = wct->len;
+		if (px >= gl->cellsize) {
+			wct->buf[wct->len++] = ' ';
+			continue;
+		}
+		gce = &gl->celldata[px];
+		if (~gce->flags & GRID_FLAG_EXTENDED) {
+			if (lower)
+				wct->buf[wct->len++] = tolower(gce->data.data);
+			else
+				wct->buf[wct->len++] = gce->data.data;
+			continue;
+		}
+		utf8_to_data(gl->extddata[gce->offset].data, &ud);
+		if (ud.size == 1 && lower)
+			wct->buf[wct->len++] = tolower(ud.data[0]);
+		else {
+			memcpy(wct->buf + wct->len, ud.data, ud.size);
+			wct->len += ud.size;
+		}
+	}
+	if (cells)
+		wct->offsets[wct->cells] = wct->len;
+}
+
+/* Free the text buffer. */
+static void
+window_copy_text_free(struct window_copy_text *wct)
+{
+	free(wct->buf);
+	free(wct->offsets);
+	memset(wct, 0, sizeof *wct);
+}
+
+/*
+ * Load the text of a line and the lines it is wrapped with, unless it is
+ * already loaded.
+ */
+static void
+window_copy_text_load(struct window_copy_text *wct, struct grid *gd, u_int py,
+    int lower, int cells)
+{
+	u_int	first = py, last = py, yy;
+
+	if (wct->valid && py >= wct->first && py <= wct->last)
+		return;
+
+	while (first > 0) {
+		if (~grid_peek_line(gd, first - 1)->flags & GRID_LINE_WRAPPED)
+			break;
+		first--;
+	}
+	while (last < gd->hsize + gd->sy - 1) {
+		if (~grid_peek_line(gd, last)->flags & GRID_LINE_WRAPPED)
+			break;
+		last++;
+	}
+
+	wct->len = 0;
+	wct->cells = 0;
+	for (yy = first; yy <= last; yy++)
+		window_copy_text_append(wct, gd, yy, lower, cells);
+	wct->valid = 1;
+	wct->first = first;
+	wct->last = last;
+}
+
+/* Build the index entries for a line and the lines it is wrapped with. */
+static void
+window_copy_index_build(struct window_copy_mode_data *data, u_int py)
+{
+	struct grid		*gd = data->backing->grid;
+	struct window_copy_text	 wct = { 0 };
+	u_int			 yy;
+	size_t			 i;
+	uint64_t		 bits[4] = { 0 };
+
+	window_copy_text_load(&wct, gd, py, 1, 1);
+
+	/*
+	 * Work backwards, so each line gets the trigrams from its start to the
+	 * end of the last line.
+	 */
+	yy = wct.last;
+	for (i = wct.len; i > 0; i--) {
+		if (i + 2 <= wct.len)
+			window_copy_index_add(bits, wct.buf + i - 1);
+		if (i - 1 == wct.offsets[(yy - wct.first) * gd->sx]) {
+			memcpy(data->index[yy].bits, bits, sizeof bits);
+			data->index[yy].built = 1;
+			yy--;
+		}
+	}
+
+	window_copy_text_free(&wct);
+}
+
+/*
+ * Get the trigrams in a search string. Returns 0 if it is too short to have
+ * any.
+ */
+static int
+window_copy_index_query(struct grid *sgd, uint64_t *bits)
+{
+	struct window_copy_text	wct = { 0 };
+	size_t			i, len;
+
+	memset(bits, 0, 4 * sizeof *bits);
+	window_copy_text_append(&wct, sgd, 0, 1, 0);
+	for (i = 0; i + 3 <= wct.len; i++)
+		window_copy_index_add(bits, wct.buf + i);
+	len = wct.len;
+	window_copy_text_free(&wct);
+
+	return (len >= 3);
+}
+
+/*
+ * Check if a line could contain a search string, building the index for it if
+ * needed.
+ */
+static int
+window_copy_index_check(struct window_copy_mode_data *data, u_int py,
+    const uint64_t *bits)
+{
+	struct grid			*gd = data->backing->grid;
+	struct window_copy_index	*wci;
+	u_int				 size = gd->hsize + gd->sy, i;
+
+	if (data->indexsize < size) {
+		data->index = xrecallocarray(data->index, data->indexsize, size,
+		    sizeof *data->index);
+		data->indexsize = size;
+	}
+
+	wci = &data->index[py];
+	if (!wci->built)
+		window_copy_index_build(data, py);
+	for (i = 0; i < nitems(wci->bits); i++) {
+		if ((wci->bits[i] & bits[i]) != bits[i])
+			return (0);
+	}
+	return (1);
+}
+
 static int
 window_copy_search_compare(struct grid *gd, u_int px, u_int py,
     struct grid *sgd, u_int spx, int cis)
@@ -2405,83 +2701,172 @@ window_copy_search_compare(struct grid *gd, u_int px, u_int py,
 	return (memcmp(ud->data, sud->data, ud->size) == 0);
 }
 
+/* Check if the search string matches at a position, comparing each cell. */
 static int
-window_copy_search_lr(struct grid *gd,
-    struct grid *sgd, u_int *ppx, u_int py, u_int first, u_int last, int cis)
+window_copy_search_cells(struct grid *gd, struct grid *sgd, u_int ax, u_int py,
+    int cis)
 {
-	u_int			 ax, bx, px, pywrap, endline;
-	int			 matched;
+	u_int			 bx, px, pywrap, endline;
 	struct grid_line	*gl;
 
 	endline = gd->hsize + gd->sy - 1;
-	for (ax = first; ax < last; ax++) {
-		for (bx = 0; bx < sgd->sx; bx++) {
-			px = ax + bx;
-			pywrap = py;
-			/* Wrap line. */
-			while (px >= gd->sx && pywrap < endline) {
-				gl = grid_get_line(gd, pywrap);
-				if (~gl->flags & GRID_LINE_WRAPPED)
-					break;
-				px -= gd->sx;
-				pywrap++;
-			}
-			/* We have run off the end of the grid. */
-			if (px >= gd->sx)
-				break;
-			matched = window_copy_search_compare(gd, px, pywrap,
-			    sgd, bx, cis);
-			if (!matched)
+	for (bx = 0; bx < sgd->sx; bx++) {
+		px = ax + bx;
+		pywrap = py;
+		/* Wrap line. */
+		while (px >= gd->sx && pywrap < endline) {
+			gl = grid_get_line(gd, pywrap);
+			if (~gl->flags & GRID_LINE_WRAPPED)
 				break;
+			px -= gd->sx;
+			pywrap++;
 		}
-		if (bx == sgd->sx) {
-			*ppx = ax;
-			return (1);
-		}
+		/* We have run off the end of the grid. */
+		if (px >= gd->sx)
+			return (0);
+		if (!window_copy_search_compare(gd, px, pywrap, sgd, bx, cis))
+			return (0);
 	}
-	return (0);
+	return (1);
 }
 
+/*
+ * Find the cell starting at an offset in the text. Returns 0 if the offset is
+ * not at the start of a cell.
+ */
 static int
-window_copy_search_rl(struct grid *gd,
-    struct grid *sgd, u_int *ppx, u_int py, u_int first, u_int last, int cis)
+window_copy_text_cell(struct window_copy_text *wct, size_t offset,
+    u_int *cell)
 {
-	u_int			 ax, bx, px, pywrap, endline;
-	int			 matched;
-	struct grid_line	*gl;
+	u_int	lo = 0, hi = wct->cells, mid;
 
-	endline = gd->hsize + gd->sy - 1;
-	for (ax = last; ax > first; ax--) {
-		for (bx = 0; bx < sgd->sx; bx++) {
-			px = ax - 1 + bx;
-			pywrap = py;
-			/* Wrap line. */
-			while (px >= gd->sx && pywrap < endline) {
-				gl = grid_get_line(gd, pywrap);
-				if (~gl->flags & GRID_LINE_WRAPPED)
-					break;
-				px -= gd->sx;
-				pywrap++;
+	/* Padding cells have the same offset as the cell after them. */
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (wct->offsets[mid] <= offset)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	if (wct->offsets[lo] != offset)
+		return (0);
+	*cell = lo;
+	return (1);
+}
+
+/*
+ * Find the next match of the search string in the text from a cell. The text
+ * is searched with memmem and each match checked against the cells, since a
+ * match of the bytes may not start at a cell or may differ in padding.
+ */
+static int
+window_copy_search_text(struct grid *gd, struct grid *sgd,
+    struct window_copy_text *needle, struct window_copy_text *text,
+    u_int *cell, u_int py, u_int last, int cis)
+{
+	const u_char	*found;
+	size_t		 offset;
+	u_int		 base;
+
+	base = (py - text->first) * gd->sx;
+	offset = text->offsets[base + *cell];
+	while (offset <= text->len) {
+		found = memmem(text->buf + offset, text->len - offset,
+		    needle->buf, needle->len);
+		if (found == NULL)
+			return (0);
+		offset = found - text->buf;
+		if (window_copy_text_cell(text, offset, cell)) {
+			if (*cell >= base + last)
+				return (0);
+			if (window_copy_search_cells(gd, sgd, *cell - base, py,
+			    cis)) {
+				*cell -= base;
+				return (1);
 			}
-			/* We have run off the end of the grid. */
-			if (px >= gd->sx)
-				break;
-			matched = window_copy_search_compare(gd, px, pywrap,
-			    sgd, bx, cis);
-			if (!matched)
-				break;
-		}
-		if (bx == sgd->sx) {
-			*ppx = ax - 1;
-			return (1);
 		}
+		offset++;
 	}
 	return (0);
 }
 
+static int
+window_copy_search_lr(struct grid *gd, struct grid *sgd,
+    struct window_copy_text *needle, struct window_copy_text *text, u_int *ppx,
+    u_int py, u_int first, u_int last, int cis)
+{
+	u_int	cell = first;
+
+	if (first >= last)
+		return (0);
+	window_copy_text_load(text, gd, py, cis, 1);
+	if (!window_copy_search_text(gd, sgd, needle, text, &cell, py, last,
+	    cis))
+		return (0);
+	*ppx = cell;
+	return (1);
+}
+
+static int
+window_copy_search_rl(struct grid *gd, struct grid *sgd,
+    struct window_copy_text *needle, struct window_copy_text *text, u_int *ppx,
+    u_int py, u_int first, u_int last, int cis)
+{
+	u_int	cell = first;
+	int	found = 0;
+
+	if (first >= last)
+		return (0);
+	window_copy_text_load(text, gd, py, cis, 1);
+	while (cell < last && window_copy_search_text(gd, sgd, needle, text,
+	    &cell, py, last, cis)) {
+		*ppx = cell++;
+		found = 1;
+	}
+	return (found);
+}
+
+/*
+ * Get the compiled regex for a pattern. The last one compiled is kept in the
+ * pane, so searching again or marking the matches does not compile it again.
+ */
+static const regex_t *
+window_copy_get_regex(struct window_pane *wp, const char *pattern, int cflags)
+{
+	struct window_copy_regex	*wcr = wp->searchcache;
+
+	if (wcr != NULL) {
+		if (wcr->cflags == cflags && strcmp(wcr->pattern, pattern) == 0)
+			return (&wcr->reg);
+		window_copy_free_regex(wcr);
+		wp->searchcache = NULL;
+	}
+
+	wcr = xcalloc(1, sizeof *wcr);
+	if (regcomp(&wcr->reg, pattern, cflags) != 0) {
+		free(wcr);
+		return (NULL);
+	}
+	wcr->pattern = xstrdup(pattern);
+	wcr->cflags = cflags;
+	wp->searchcache = wcr;
+	return (&wcr->reg);
+}
+
+/* Free a compiled regex. */
+void
+window_copy_free_regex(struct window_copy_regex *wcr)
+{
+	if (wcr == NULL)
+		return;
+	regfree(&wcr->reg);
+	free(wcr->pattern);
+	free(wcr);
+}
+
 static int
 window_copy_search_lr_regex(struct grid *gd, u_int *ppx, u_int *psx, u_int py,
-    u_int first, u_int last, regex_t *reg)
+    u_int first, u_int last, const regex_t *reg)
 {
 	int			eflags = 0;
 	u_int			endline, foundx, foundy, len, pywrap, size = 1;
@@ -2546,7 +2931,7 @@ window_copy_search_lr_regex(struct grid *gd, u_int *ppx, u_int *psx, u_int py,
 
 static int
 window_copy_search_rl_regex(struct grid *gd, u_int *ppx, u_int *psx, u_int py,
-    u_int first, u_int last, regex_t *reg)
+    u_int first, u_int last, const regex_t *reg)
 {
 	int			eflags = 0;
 	u_int			endline, len, pywrap, size = 1;
@@ -2609,6 +2994,11 @@ window_copy_cellstring(const struct grid_line *gl, u_int px, size_t *size,
 
 	utf8_to_data(gl->extddata[gce->offset].data, &ud);
 	*size = ud.size;
+	if (ud.size == 0) {
+		/* Padding cells have no text. */
+		*allocated = 0;
+		return ("");
+	}
 	*allocated = 1;
 
 	copy = xmalloc(ud.size);
@@ -2840,79 +3230,255 @@ window_copy_is_lowercase(const char *ptr)
 	return (1);
 }
 
+/* Get how far through a running search is as a percentage. */
+static u_int
+window_copy_search_progress(struct window_copy_mode_data *data)
+{
+	struct grid	*gd = data->backing->grid;
+	u_int		 total = gd->hsize + gd->sy + 1;
+
+	if (data->search->lines >= total)
+		return (100);
+	return ((data->search->lines * 100ULL) / total);
+}
+
+/* Stop any search which is running. */
+static void
+window_copy_search_cancel(struct window_mode_entry *wme)
+{
+	struct window_copy_mode_data	*data = wme->data;
+	struct window_copy_search	*ws = data->search;
+
+	if (ws == NULL)
+		return;
+	data->search = NULL;
+
+	evtimer_del(&ws->timer);
+	screen_free(&ws->ss);
+	free(ws->pattern);
+	window_copy_text_free(&ws->needle);
+	window_copy_text_free(&ws->text);
+	free(ws);
+}
+
 /*
- * Search for text stored in sgd starting from position fx,fy up to endline. If
- * found, jump to it. If cis then ignore case. The direction is 0 for searching
- * up, down otherwise. If wrap then go to begin/end of grid and try again if
- * not found.
+ * Search one slice of lines. Returns 1 and the position if found, 0 if not
+ * found or -1 if the search is not finished.
  */
 static int
-window_copy_search_jump(struct window_mode_entry *wme, struct grid *gd,
-    struct grid *sgd, u_int fx, u_int fy, u_int endline, int cis, int wrap,
-    int direction, int regex)
+window_copy_search_step(struct window_mode_entry *wme, u_int *ppx, u_int *ppy)
 {
-	u_int	 i, px, sx, ssize = 1;
-	int	 found = 0, cflags = REG_EXTENDED;
-	char	*sbuf;
-	regex_t	 reg;
-
-	if (regex) {
-		sbuf = xmalloc(ssize);
-		sbuf[0] = '\0';
-		sbuf = window_copy_stringify(sgd, 0, 0, sgd->sx, sbuf, &ssize);
-		if (cis)
-			cflags |= REG_ICASE;
-		if (regcomp(&reg, sbuf, cflags) != 0) {
-			free(sbuf);
+	struct window_copy_mode_data	*data = wme->data;
+	struct window_copy_search	*ws = data->search;
+	struct grid			*gd = data->backing->grid;
+	struct grid			*sgd = ws->ss.grid;
+	const regex_t			*reg = NULL;
+	u_int				 px, sx, py;
+	int				 found;
+	uint64_t			 end;
+
+	if (ws->regex) {
+		reg = window_copy_get_regex(wme->wp, ws->pattern, ws->cflags);
+		if (reg == NULL)
 			return (0);
-		}
 	}
 
-	if (direction) {
-		for (i = fy; i <= endline; i++) {
-			if (regex) {
-				found = window_copy_search_lr_regex(gd,
-				    &px, &sx, i, fx, gd->sx, &reg);
-			} else {
-				found = window_copy_search_lr(gd, sgd,
-				    &px, i, fx, gd->sx, cis);
-			}
-			if (found)
-				break;
-			fx = 0;
+	end = get_timer() + WINDOW_COPY_SEARCH_SLICE;
+	for (;;) {
+		py = ws->py;
+		if (ws->indexed && !window_copy_index_check(data, py, ws->bits))
+			found = 0;
+		else if (ws->direction && ws->regex) {
+			found = window_copy_search_lr_regex(gd, &px, &sx, py,
+			    ws->fx, gd->sx, reg);
+		} else if (ws->direction) {
+			found = window_copy_search_lr(gd, sgd, &ws->needle,
+			    &ws->text, &px, py, ws->fx, gd->sx, ws->cis);
+		} else if (ws->regex) {
+			found = window_copy_search_rl_regex(gd, &px, &sx, py,
+			    0, ws->fx + 1, reg);
+		} else {
+			found = window_copy_search_rl(gd, sgd, &ws->needle,
+			    &ws->text, &px, py, 0, ws->fx + 1, ws->cis);
 		}
-	} else {
-		for (i = fy + 1; endline < i; i--) {
-			if (regex) {
-				found = window_copy_search_rl_regex(gd,
-				    &px, &sx, i - 1, 0, fx + 1, &reg);
+		if (found) {
+			*ppx = px;
+			*ppy = py;
+			return (1);
+		}
+		ws->lines++;
+
+		/*
+		 * If at the last line, wrap around and search from the other
+		 * end of the grid up to where this search started.
+		 */
+		if (py == ws->endline) {
+			if (!ws->wrap)
+				return (0);
+			ws->wrap = 0;
+			ws->endline = ws->first;
+			if (ws->direction) {
+				ws->fx = 0;
+				ws->py = 0;
 			} else {
-				found = window_copy_search_rl(gd, sgd,
-				    &px, i - 1, 0, fx + 1, cis);
-			}
-			if (found) {
-				i--;
-				break;
+				ws->fx = gd->sx - 1;
+				ws->py = gd->hsize + gd->sy - 1;
 			}
-			fx = gd->sx - 1;
+		} else if (ws->direction) {
+			ws->fx = 0;
+			ws->py++;
+		} else {
+			ws->fx = gd->sx - 1;
+			ws->py--;
 		}
+
+		if (ws->lines % 64 == 0 && get_timer() >= end)
+			return (-1);
 	}
+}
+
+/*
+ * Start a search for searchstr from the cursor. The direction is 0 for
+ * searching up, down otherwise.
+ */
+static int
+window_copy_search_start(struct window_mode_entry *wme, int direction,
+    int regex, int visible_only, u_int repeat)
+{
+	struct window_pane		*wp = wme->wp;
+	struct window_copy_mode_data	*data = wme->data;
+	struct window_copy_search	*ws;
+	struct screen			*s = data->backing;
+	struct screen_write_ctx		 ctx;
+	struct grid			*gd = s->grid;
+	const char			*str = data->searchstr;
+	u_int				 fx, fy, ssize = 1;
+
+	ws = xcalloc(1, sizeof *ws);
+	ws->direction = direction;
+	ws->visible_only = visible_only;
+	ws->repeat = repeat;
+
+	screen_init(&ws->ss, screen_write_strlen("%s", str), 1, 0);
+	screen_write_start(&ctx, &ws->ss);
+	screen_write_nputs(&ctx, -1, &grid_default_cell, "%s", str);
+	screen_write_stop(&ctx);
+
+	ws->wrap = options_get_number(wp->window->options, "wrap-search");
+	ws->cis = window_copy_is_lowercase(str);
+
 	if (regex) {
-		free(sbuf);
-		regfree(&reg);
+		ws->pattern = xmalloc(ssize);
+		ws->pattern[0] = '\0';
+		ws->pattern = window_copy_stringify(ws->ss.grid, 0, 0,
+		    ws->ss.grid->sx, ws->pattern, &ssize);
+		ws->cflags = REG_EXTENDED;
+		if (ws->cis)
+			ws->cflags |= REG_ICASE;
+		if (window_copy_get_regex(wp, ws->pattern, ws->cflags) == NULL) {
+			free(ws->pattern);
+			screen_free(&ws->ss);
+			free(ws);
+			return (0);
+		}
+		ws->regex = 1;
+	} else {
+		ws->indexed = window_copy_index_query(ws->ss.grid, ws->bits);
+		window_copy_text_append(&ws->needle, ws->ss.grid, 0, 0, 0);
 	}
 
+	fx = data->cx;
+	fy = screen_hsize(data->backing) - data->oy + data->cy;
+	if (direction) {
+		window_copy_move_right(s, &fx, &fy, ws->wrap);
+		ws->endline = gd->hsize + gd->sy - 1;
+	} else {
+		window_copy_move_left(s, &fx, &fy, ws->wrap);
+		ws->endline = 0;
+	}
+	ws->fx = fx;
+	ws->py = ws->first = fy;
+
+	evtimer_set(&ws->timer, window_copy_search_timer, wme);
+	data->search = ws;
+	return (1);
+}
+
+/* Finish a search, jumping to the match if found. */
+static void
+window_copy_search_finish(struct window_mode_entry *wme, int found, u_int px,
+    u_int py)
+{
+	struct window_copy_mode_data	*data = wme->data;
+	struct window_copy_search	*ws = data->search;
+
 	if (found) {
-		window_copy_scroll_to(wme, px, i, 1);
-		return (1);
+		window_copy_scroll_to(wme, px, py, 1);
+		window_copy_search_marks(wme, &ws->ss, ws->regex,
+		    ws->visible_only);
+	} else if (ws->async && !ws->visible_only)
+		window_copy_clear_marks(wme);
+	window_copy_search_cancel(wme);
+	window_copy_redraw_screen(wme);
+}
+
+/*
+ * Run a search until it is finished or has used up its slice of time. If it
+ * is not finished, it continues from the event loop. Returns 0 if not found.
+ */
+static int
+window_copy_search_run(struct window_mode_entry *wme)
+{
+	struct window_copy_mode_data	*data = wme->data;
+	struct window_copy_search	*ws;
+	struct timeval			 tv = { 0 };
+	u_int				 px, py, repeat;
+	int				 found, direction, regex;
+
+	for (;;) {
+		ws = data->search;
+		found = window_copy_search_step(wme, &px, &py);
+		if (found == -1) {
+			if (!ws->async) {
+				ws->async = 1;
+				if (!ws->visible_only)
+					window_copy_clear_marks(wme);
+			}
+			window_copy_redraw_lines(wme, 0, 1);
+			evtimer_add(&ws->timer, &tv);
+			return (1);
+		}
+
+		direction = ws->direction;
+		regex = ws->regex;
+		repeat = ws->repeat;
+		window_copy_search_finish(wme, found, px, py);
+		if (!found || repeat == 0)
+			return (found);
+
+		/* Search again from the match. */
+		if (!window_copy_search_start(wme, direction, regex, 1,
+		    repeat - 1))
+			return (0);
 	}
-	if (wrap) {
-		return (window_copy_search_jump(wme, gd, sgd,
-		    direction ? 0 : gd->sx - 1,
-		    direction ? 0 : gd->hsize + gd->sy - 1, fy, cis, 0,
-		    direction, regex));
+}
+
+/* Continue a search from the event loop. */
+static void
+window_copy_search_timer(__unused int fd, __unused short events, void *arg)
+{
+	struct window_mode_entry	*wme = arg;
+	struct window_copy_mode_data	*data = wme->data;
+	struct timeval			 tv = {
+		.tv_usec = WINDOW_COPY_SEARCH_SLICE * 1000
+	};
+
+	/* Wait if another mode is on top of this one. */
+	if (TAILQ_FIRST(&wme->wp->modes) != wme) {
+		evtimer_add(&data->search->timer, &tv);
+		return;
 	}
-	return (0);
+	window_copy_search_run(wme);
 }
 
 /*
@@ -2924,12 +3490,9 @@ window_copy_search(struct window_mode_entry *wme, int direction, int regex)
 {
 	struct window_pane		*wp = wme->wp;
 	struct window_copy_mode_data	*data = wme->data;
-	struct screen			*s = data->backing, ss;
-	struct screen_write_ctx		 ctx;
-	struct grid			*gd = s->grid;
+	struct window_copy_search	*ws = data->search;
 	const char			*str = data->searchstr;
-	u_int				 fx, fy, endline;
-	int				 wrapflag, cis, found, visible_only;
+	int				 visible_only;
 
 	if (regex && str[strcspn(str, "^$*+()?[].\\")] == '\0')
 		regex = 0;
@@ -2937,6 +3500,20 @@ window_copy_search(struct window_mode_entry *wme, int direction, int regex)
 	if (data->timeout)
 		return (0);
 
+	/*
+	 * If the same search is already running, search again once it has
+	 * finished. Any other search replaces it.
+	 */
+	if (ws != NULL) {
+		if (ws->direction == direction &&
+		    ws->regex == regex &&
+		    strcmp(wp->searchstr, str) == 0) {
+			ws->repeat++;
+			return (1);
+		}
+		window_copy_search_cancel(wme);
+	}
+
 	if (wp->searchstr == NULL || wp->searchregex != regex)
 		visible_only = 0;
 	else
@@ -2945,33 +3522,11 @@ window_copy_search(struct window_mode_entry *wme, int direction, int regex)
 	wp->searchstr = xstrdup(str);
 	wp->searchregex = regex;
 
-	fx = data->cx;
-	fy = screen_hsize(data->backing) - data->oy + data->cy;
-
-	screen_init(&ss, screen_write_strlen("%s", str), 1, 0);
-	screen_write_start(&ctx, &ss);
-	screen_write_nputs(&ctx, -1, &grid_default_cell, "%s", str);
-	screen_write_stop(&ctx);
-
-	wrapflag = options_get_number(wp->window->options, "wrap-search");
-	cis = window_copy_is_lowercase(str);
-
-	if (direction) {
-		window_copy_move_right(s, &fx, &fy, wrapflag);
-		endline = gd->hsize + gd->sy - 1;
-	} else {
-		window_copy_move_left(s, &fx, &fy, wrapflag);
-		endline = 0;
+	if (!window_copy_search_start(wme, direction, regex, visible_only, 0)) {
+		window_copy_redraw_screen(wme);
+		return (0);
 	}
-
-	found = window_copy_search_jump(wme, gd, ss.grid, fx, fy, endline, cis,
-	    wrapflag, direction, regex);
-	if (found)
-		window_copy_search_marks(wme, &ss, regex, visible_only);
-	window_copy_redraw_screen(wme);
-
-	screen_free(&ss);
-	return (found);
+	return (window_copy_search_run(wme));
 }
 
 static void
@@ -3012,13 +3567,14 @@ window_copy_search_marks(struct window_mode_entry *wme, struct screen *ssp,
 	struct screen			*s = data->backing, ss;
 	struct screen_write_ctx		 ctx;
 	struct grid			*gd = s->grid;
+	struct window_copy_text		 needle = { 0 }, text = { 0 };
 	int				 found, cis, which = -1, stopped = 0;
-	int				 cflags = REG_EXTENDED;
+	int				 cflags = REG_EXTENDED, indexed;
 	u_int				 px, py, i, b, nfound = 0, width;
 	u_int				 ssize = 1, start, end;
 	char				*sbuf;
-	regex_t				 reg;
-	uint64_t			 stop = 0, tstart, t;
+	const regex_t			*reg = NULL;
+	uint64_t			 stop = 0, tstart, t, bits[4];
 
 	if (ssp == NULL) {
 		width = screen_write_strlen("%s", data->searchstr);
@@ -3033,6 +3589,9 @@ window_copy_search_marks(struct window_mode_entry *wme, struct screen *ssp,
 
 	cis = window_copy_is_lowercase(data->searchstr);
 
+	indexed = (!regex && window_copy_index_query(ssp->grid, bits));
+	if (!regex)
+		window_copy_text_append(&needle, ssp->grid, 0, 0, 0);
 	if (regex) {
 		sbuf = xmalloc(ssize);
 		sbuf[0] = '\0';
@@ -3040,10 +3599,10 @@ window_copy_search_marks(struct window_mode_entry *wme, struct screen *ssp,
 		    sbuf, &ssize);
 		if (cis)
 			cflags |= REG_ICASE;
-		if (regcomp(&reg, sbuf, cflags) != 0) {
-			free(sbuf);
+		reg = window_copy_get_regex(wme->wp, sbuf, cflags);
+		free(sbuf);
+		if (reg == NULL)
 			return (0);
-		}
 	}
 	tstart = get_timer();
 
@@ -3062,15 +3621,17 @@ again:
 
 	for (py = start; py < end; py++) {
 		px = 0;
+		if (indexed && !window_copy_index_check(data, py, bits))
+			goto next;
 		for (;;) {
 			if (regex) {
 				found = window_copy_search_lr_regex(gd,
-				    &px, &width, py, px, gd->sx, &reg);
+				    &px, &width, py, px, gd->sx, reg);
 				if (!found)
 					break;
 			} else {
 				found = window_copy_search_lr(gd, ssp->grid,
-				    &px, py, px, gd->sx, cis);
+				    &needle, &text, &px, py, px, gd->sx, cis);
 				if (!found)
 					break;
 			}
@@ -3094,6 +3655,7 @@ again:
 			px++;
 		}
 
+next:
 		t = get_timer();
 		if (t - tstart > WINDOW_COPY_SEARCH_TIMEOUT) {
 			data->timeout = 1;
@@ -3141,10 +3703,8 @@ again:
 out:
 	if (ssp == &ss)
 		screen_free(&ss);
-	if (regex) {
-		free(sbuf);
-		regfree(&reg);
-	}
+	window_copy_text_free(&needle);
+	window_copy_text_free(&text);
 	return (1);
 }
 
@@ -3350,7 +3910,11 @@ window_copy_write_line(struct window_mode_entry *wme,
 	mkgc.flags |= GRID_FLAG_NOPALETTE;
 
 	if (py == 0 && s->rupper < s->rlower && !data->hide_position) {
-		if (data->searchmark == NULL) {
+		if (data->search != NULL && data->search->async) {
+			size = xsnprintf(hdr, sizeof hdr,
+			    "(searching %u%%) [%u/%u]",
+			    window_copy_search_progress(data), data->oy, hsize);
+		} else if (data->searchmark == NULL) {
 			if (data->timeout) {
 				size = xsnprintf(hdr, sizeof hdr,
 				    "(timed out) [%u/%u]", data->oy, hsize);
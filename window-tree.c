@@ -831,7 +831,7 @@ window_tree_search(__unused void *modedata, void *itemdata, const char *ss)
 	case WINDOW_TREE_PANE:
 		if (s == NULL || wl == NULL || wp == NULL)
 			break;
-		cmd = osdep_get_name(wp->fd, wp->tty);
+		cmd = window_pane_get_name(wp);
 		if (cmd == NULL || *cmd == '\0')
 			return (0);
 		retval = (strstr(cmd, ss) != NULL);
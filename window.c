@@ -885,6 +885,8 @@ window_pane_create(struct window *w, u_int sx, u_int sy, u_int hlimit)
 	wp->bg = 8;
 
 	TAILQ_INIT(&wp->modes);
+	RB_INIT(&wp->memos);
+	TAILQ_INIT(&wp->chunks);
 
 	wp->layout_cell = NULL;
 
@@ -911,8 +913,17 @@ window_pane_create(struct window *w, u_int sx, u_int sy, u_int hlimit)
 static void
 window_pane_destroy(struct window_pane *wp)
 {
+	struct window_pane_chunk	*wpc, *wpc1;
+
 	window_pane_reset_mode_all(wp);
 	free(wp->searchstr);
+	window_copy_free_regex(wp->searchcache);
+
+	/* Chunks still queued for clients are freed when they are written. */
+	TAILQ_FOREACH_SAFE(wpc, &wp->chunks, entry, wpc1) {
+		TAILQ_REMOVE(&wp->chunks, wpc, entry);
+		wpc->wp = NULL;
+	}
 
 	if (wp->fd != -1) {
 #ifdef HAVE_UTEMPTER
@@ -927,6 +938,10 @@ window_pane_destroy(struct window_pane *wp)
 	screen_free(&wp->status_screen);
 
 	screen_free(&wp->base);
+	format_free_memos(&wp->memos);
+
+	free(wp->sample_name);
+	free(wp->sample_cwd);
 
 	if (wp->pipe_fd != -1) {
 		bufferevent_free(wp->pipe_event);
@@ -945,6 +960,7 @@ window_pane_destroy(struct window_pane *wp)
 	free(wp->shell);
 	cmd_free_argv(wp->argc, wp->argv);
 	free(wp->palette);
+	free(wp->redraw_lines);
 	free(wp);
 }
 
@@ -1013,6 +1029,7 @@ window_pane_resize(struct window_pane *wp, u_int sx, u_int sy)
 
 	log_debug("%s: %%%u resize %ux%u", __func__, wp->id, sx, sy);
 	screen_resize(&wp->base, sx, sy, wp->base.saved_grid == NULL);
+	format_free_memos(&wp->memos);
 
 	wme = TAILQ_FIRST(&wp->modes);
 	if (wme != NULL && wme->mode->resize != NULL)
@@ -1027,6 +1044,40 @@ window_pane_resize(struct window_pane *wp, u_int sx, u_int sy)
 	wp->flags |= PANE_RESIZE;
 }
 
+/*
+ * Mark lines of a pane to be redrawn. The whole pane is redrawn instead if all
+ * the lines are marked.
+ */
+void
+window_pane_redraw_lines(struct window_pane *wp, u_int py, u_int ny)
+{
+	if (wp->flags & PANE_REDRAW)
+		return;
+	if (py >= wp->sy)
+		return;
+	if (ny > wp->sy - py)
+		ny = wp->sy - py;
+	if (ny == 0)
+		return;
+	if (ny == wp->sy) {
+		wp->flags |= PANE_REDRAW;
+		return;
+	}
+
+	if (wp->redraw_size != wp->sy) {
+		if (wp->flags & PANE_REDRAWLINES) {
+			wp->flags |= PANE_REDRAW;
+			return;
+		}
+		free(wp->redraw_lines);
+		if ((wp->redraw_lines = bit_alloc(wp->sy)) == NULL)
+			fatal("bit_alloc failed");
+		wp->redraw_size = wp->sy;
+	}
+	bit_nset(wp->redraw_lines, py, py + ny - 1);
+	wp->flags |= PANE_REDRAWLINES;
+}
+
 void
 window_pane_set_palette(struct window_pane *wp, u_int n, int colour)
 {
@@ -1597,3 +1648,95 @@ window_pane_update_used_data(struct window_pane *wp,
 		size = EVBUFFER_LENGTH(wp->event->input) - used;
 	wpo->used += size;
 }
+
+/*
+ * Add a reference to the chunk for the pane buffer from start to end. Clients
+ * queue the same new output each time, so this is normally the last chunk.
+ * The chunks are kept in order of their start, so the first chunk is the
+ * furthest back any client needs.
+ */
+struct window_pane_chunk *
+window_pane_add_chunk(struct window_pane *wp, size_t start, size_t end)
+{
+	struct window_pane_chunk	*wpc, *loop;
+
+	wpc = TAILQ_LAST(&wp->chunks, window_pane_chunks);
+	if (wpc == NULL || wpc->end != end) {
+		wpc = xcalloc(1, sizeof *wpc);
+		wpc->wp = wp;
+		wpc->start = start;
+		wpc->end = end;
+		TAILQ_INSERT_TAIL(&wp->chunks, wpc, entry);
+	}
+	wpc->references++;
+
+	loop = wpc;
+	while (loop != NULL && loop->start > start) {
+		loop->start = start;
+		loop = TAILQ_PREV(loop, window_pane_chunks, entry);
+	}
+	return (wpc);
+}
+
+/* Release a reference to a chunk, freeing it if no longer needed. */
+void
+window_pane_release_chunk(struct window_pane_chunk *wpc)
+{
+	if (--wpc->references != 0)
+		return;
+	if (wpc->wp != NULL)
+		TAILQ_REMOVE(&wpc->wp->chunks, wpc, entry);
+	free(wpc);
+}
+
+/* Has a process name or directory sample expired? If so, start a new one. */
+static int
+window_pane_sample_expired(struct window_pane *wp, int flag,
+    struct timeval *tv)
+{
+	struct timeval	now, offset;
+
+	gettimeofday(&now, NULL);
+	if (wp->flags & flag) {
+		timersub(&now, tv, &offset);
+		if (offset.tv_sec < PANE_SAMPLE_INTERVAL)
+			return (0);
+	}
+	memcpy(tv, &now, sizeof *tv);
+	wp->flags |= flag;
+	return (1);
+}
+
+/*
+ * Get the name of the foreground process in a pane. This is sampled at most
+ * once in each interval unless there is output from the pane.
+ */
+char *
+window_pane_get_name(struct window_pane *wp)
+{
+	if (window_pane_sample_expired(wp, PANE_NAMESAMPLED,
+	    &wp->sample_name_time)) {
+		free(wp->sample_name);
+		wp->sample_name = osdep_get_name(wp->fd, wp->tty);
+	}
+	if (wp->sample_name == NULL)
+		return (NULL);
+	return (xstrdup(wp->sample_name));
+}
+
+/* Get the directory of the foreground process in a pane. */
+const char *
+window_pane_get_cwd(struct window_pane *wp)
+{
+	const char	*cwd;
+
+	if (window_pane_sample_expired(wp, PANE_CWDSAMPLED,
+	    &wp->sample_cwd_time)) {
+		free(wp->sample_cwd);
+		if ((cwd = osdep_get_cwd(wp->fd)) != NULL)
+			wp->sample_cwd = xstrdup(cwd);
+		else
+			wp->sample_cwd = NULL;
+	}
+	return (wp->sample_cwd);
+}